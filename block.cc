@@ -3,18 +3,18 @@
 
 #include "block.h"
 
-Block::Block() : data(0), length(0), lastaccessed(-1), dirty(false)
+Block::Block() : data(0), length(0), lastaccessed(-1), loadedat(-1), dirty(false), pins(0)
 {}
 
 
-Block::Block(const SIZE_T s) : data(0), length(0), lastaccessed(-1), dirty(false)
+Block::Block(const SIZE_T s) : data(0), length(0), lastaccessed(-1), loadedat(-1), dirty(false), pins(0)
 {
   Resize(s);
 }
 
 
 
-Block::Block(const Block &rhs) : data(0), length(0), lastaccessed(rhs.lastaccessed), dirty(rhs.dirty)
+Block::Block(const Block &rhs) : data(0), length(0), lastaccessed(rhs.lastaccessed), loadedat(rhs.loadedat), dirty(rhs.dirty), pins(0)
 {
   if (Resize(rhs.length)!=ERROR_NOERROR) { 
     throw GenericException();
@@ -22,7 +22,7 @@ Block::Block(const Block &rhs) : data(0), length(0), lastaccessed(rhs.lastaccess
   memcpy(data,rhs.data,rhs.length);
 }
 
-Block::Block(const char * str) : data(0), length(0), lastaccessed(-1), dirty(false)
+Block::Block(const char * str) : data(0), length(0), lastaccessed(-1), loadedat(-1), dirty(false), pins(0)
 {
   if (Resize(strlen(str))!=ERROR_NOERROR) { 
     throw GenericException();
@@ -35,7 +35,9 @@ Block::~Block()
   if (data) { delete [] data; data=0; }
   length=0;
   lastaccessed=-1;
+  loadedat=-1;
   dirty=false;
+  pins=0;
 }
 
 Block & Block::operator=(const Block &rhs)
@@ -86,17 +88,18 @@ static char low2hex(BYTE_T x)
 
 
 
-#define MAX(x,y) ((x)>(y) ? (x) : (y))
-
+// Ordered as memcmp orders them, with a shorter block that matches a
+// longer one as far as it goes less than it
 bool Block::operator<(const Block &rhs) const
 {
-  return memcmp(data,rhs.data,MAX(length,rhs.length))<0;
+  int c=memcmp(data,rhs.data,MIN(length,rhs.length));
+  return c<0 || (c==0 && length<rhs.length);
 }
 
 
 bool Block::operator==(const Block &rhs) const
 {
-  return memcmp(data,rhs.data,MAX(length,rhs.length))==0;
+  return length==rhs.length && memcmp(data,rhs.data,length)==0;
 }
 
 ostream & Block::Print(ostream &os) const
@@ -11,7 +11,9 @@ struct Block {
   BYTE_T	*data;
   SIZE_T 	length;
   double        lastaccessed;  // for use in buffercache only
+  double        loadedat;      // for use in buffercache only
   bool          dirty;         // for use in buffercahce only
+  unsigned      pins;          // for use in buffercache only, not copied
 
   Block();
   Block(const SIZE_T size);
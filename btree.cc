@@ -1,6 +1,9 @@
 #include <assert.h>
 #include "btree.h"
+#include "btree_nodet.h"
 #include <math.h>
+#include <string.h>
+#include <vector>
 
 KeyValuePair::KeyValuePair()
 {}
@@ -28,17 +31,32 @@ KeyValuePair & KeyValuePair::operator=(const KeyValuePair &rhs)
 BTreeIndex::BTreeIndex(SIZE_T keysize, 
 		       SIZE_T valuesize,
 		       BufferCache *cache,
-		       bool unique) 
+		       bool unique,
+		       int format,
+		       const KeyOrder &order,
+		       const KeyCodec &codec) 
 {
-  superblock.info.keysize=keysize;
+  // the nodes see only packed keys
+  superblock.info.keysize=codec.PackedSize(keysize);
   superblock.info.valuesize=valuesize;
+  superblock.info.format=format;
+  superblock.info.keyorder=order;
+  superblock.info.keycodec=codec;
+  superblock.info.keycodec.keysize=keysize;
   buffercache=cache;
+  keysearch=0;
+  keyorder=0;
+  keycodec=0;
+  shape=0;
   // note: ignoring unique now
 }
 
 BTreeIndex::BTreeIndex()
 {
-  // shouldn't have to do anything
+  keysearch=0;
+  keyorder=0;
+  keycodec=0;
+  shape=0;
 }
 
 
@@ -50,6 +68,11 @@ BTreeIndex::BTreeIndex(const BTreeIndex &rhs)
   buffercache=rhs.buffercache;
   superblock_index=rhs.superblock_index;
   superblock=rhs.superblock;
+  keysearch=rhs.keysearch;
+  keyorder=rhs.keyorder ? &superblock.info.keyorder : 0;
+  keycodec=rhs.keycodec ? &superblock.info.keycodec : 0;
+  shape=rhs.shape;
+  searchstats=rhs.searchstats;
 }
 
 BTreeIndex::~BTreeIndex()
@@ -88,6 +111,25 @@ ERROR_T BTreeIndex::AllocateNode(SIZE_T &n)
 }
 
 
+// true if at least num nodes can be allocated
+// (walks no more than num entries of the free list)
+bool BTreeIndex::HaveFreeNodes(const SIZE_T num) const
+{
+  SIZE_T n=superblock.info.freelist;
+  SIZE_T i;
+
+  for (i=0;i<num && n!=0;i++) { 
+    BTreeNode node;
+    if (node.Unserialize(buffercache,n)!=ERROR_NOERROR) { 
+      return false;
+    }
+    n=node.info.freelist;
+  }
+
+  return i==num;
+}
+
+
 ERROR_T BTreeIndex::DeallocateNode(const SIZE_T &n)
 {
   BTreeNode node;
@@ -112,6 +154,151 @@ ERROR_T BTreeIndex::DeallocateNode(const SIZE_T &n)
 
 }
 
+
+// true while the root has never split, and so is a leaf: it is still
+// the block after the superblock that Attach made it
+bool BTreeIndex::RootIsLeaf() const
+{
+  return superblock.info.rootnode==superblock_index+1;
+}
+
+
+//
+// Out of line values (see btree_ds.h)
+//
+
+// true if a leaf keeps value out of line
+bool BTreeIndex::Overflows(const VALUE_T &value) const
+{
+  return superblock.info.format==BTREE_FORMAT_SLOTTED && 
+    value.length>superblock.info.GetInlineValueSize();
+}
+
+// Overflow blocks value takes, 0 if it is kept in place
+SIZE_T BTreeIndex::OverflowBlocks(const VALUE_T &value) const
+{
+  if (!Overflows(value)) { 
+    return 0;
+  }
+  SIZE_T each=superblock.info.GetNumDataBytes();
+  return (value.length+each-1)/each;
+}
+
+// Store value in a new chain of overflow blocks starting at first,
+// or fail, changing nothing, if there aren't enough free blocks
+ERROR_T BTreeIndex::WriteOverflow(const VALUE_T &value, SIZE_T &first)
+{
+  const SIZE_T count=OverflowBlocks(value);
+  const SIZE_T each=superblock.info.GetNumDataBytes();
+  ERROR_T rc;
+
+  if (!HaveFreeNodes(count)) { 
+    return ERROR_NOSPACE;
+  }
+
+  vector<SIZE_T> blocks(count);
+  for (SIZE_T i=0;i<count;i++) { 
+    if ((rc=AllocateNode(blocks[i]))!=ERROR_NOERROR) { 
+      return rc;
+    }
+  }
+  for (SIZE_T i=0;i<count;i++) { 
+    BTreeNode b(BTREE_OVERFLOW_BLOCK, superblock.info.keysize, superblock.info.valuesize,
+		superblock.info.blocksize, superblock.info.format);
+    b.info.numkeys= i+1<count ? each : value.length-i*each;
+    b.info.freelist= i+1<count ? blocks[i+1] : 0;
+    memcpy(b.data,value.data+i*each,b.info.numkeys);
+    if ((rc=b.Serialize(buffercache,blocks[i]))!=ERROR_NOERROR) { 
+      return rc;
+    }
+  }
+  first=blocks[0];
+  return ERROR_NOERROR;
+}
+
+// Read the length byte value whose chain starts at block
+static ERROR_T ReadOverflow(BufferCache *cache, SIZE_T block, const SIZE_T length, VALUE_T &value)
+{
+  SIZE_T done=0;
+  ERROR_T rc;
+
+  value.Resize(length,false);
+  while (done<length) { 
+    BTreeNode b;
+    if ((rc=b.Unserialize(cache,block))!=ERROR_NOERROR) { 
+      return rc;
+    }
+    if (b.info.nodetype!=BTREE_OVERFLOW_BLOCK || b.info.numkeys>length-done ||
+	(b.info.freelist==0 && done+b.info.numkeys<length)) { 
+      return ERROR_INSANE;
+    }
+    memcpy(value.data+done,b.data,b.info.numkeys);
+    done+=b.info.numkeys;
+    block=b.info.freelist;
+  }
+  return ERROR_NOERROR;
+}
+
+// Free the chain starting at block
+ERROR_T BTreeIndex::FreeOverflow(SIZE_T block)
+{
+  ERROR_T rc;
+
+  while (block!=0) { 
+    BTreeNode b;
+    if ((rc=b.Unserialize(buffercache,block))!=ERROR_NOERROR) { 
+      return rc;
+    }
+    if (b.info.nodetype!=BTREE_OVERFLOW_BLOCK) { 
+      return ERROR_INSANE;
+    }
+    if ((rc=DeallocateNode(block))!=ERROR_NOERROR) { 
+      return rc;
+    }
+    block=b.info.freelist;
+  }
+  return ERROR_NOERROR;
+}
+
+// Set the ith key and value of leaf, the value out of line if it is
+// too long to keep in place.  A chain written for it is freed again
+// if the leaf can't take the reference.
+ERROR_T BTreeIndex::SetLeafKeyVal(BTreeNode &leaf, const SIZE_T offset, const KeyValuePair &kv)
+{
+  if (!Overflows(kv.value)) { 
+    return leaf.SetKeyVal(offset,kv);
+  }
+
+  SIZE_T first;
+  ERROR_T rc=WriteOverflow(kv.value,first);
+
+  if (rc!=ERROR_NOERROR) { 
+    return rc;
+  }
+  rc=leaf.SetKeyOverflow(offset,kv.key,first,kv.value.length);
+  if (rc!=ERROR_NOERROR) { 
+    FreeOverflow(first);
+  }
+  return rc;
+}
+
+// Set the ith value of leaf, as above
+ERROR_T BTreeIndex::SetLeafVal(BTreeNode &leaf, const SIZE_T offset, const VALUE_T &val)
+{
+  if (!Overflows(val)) { 
+    return leaf.SetVal(offset,val);
+  }
+
+  KeyValuePair kv;
+  ERROR_T rc=leaf.GetKey(offset,kv.key);
+
+  if (rc!=ERROR_NOERROR) { 
+    return rc;
+  }
+  kv.value=val;
+  return SetLeafKeyVal(leaf,offset,kv);
+}
+
 ERROR_T BTreeIndex::Attach(const SIZE_T initblock, const bool create)
 {
   ERROR_T rc;
@@ -125,10 +312,27 @@ ERROR_T BTreeIndex::Attach(const SIZE_T initblock, const bool create)
     // Superblock at superblock_index
     // root node at superblock_index+1
     // free space list for rest
+    //
+    // New indexes use the format they were constructed with
+    // (BTREE_FORMAT_CURRENT unless asked for another).  An existing 
+    // index keeps the format recorded in its superblock, so nodes we
+    // allocate later are written in that format too.  The same goes
+    // for the key order and codec.  Packed keys are in binary order,
+    // so an index can't have a codec and another order, and FOR
+    // leaves take keys as big endian integers, so neither can a FOR
+    // index.
     BTreeNode newsuperblock(BTREE_SUPERBLOCK,
 			    superblock.info.keysize,
 			    superblock.info.valuesize,
-			    buffercache->GetBlockSize());
+			    buffercache->GetBlockSize(),
+			    superblock.info.format);
+    newsuperblock.info.keyorder=superblock.info.keyorder;
+    newsuperblock.info.keycodec=superblock.info.keycodec;
+
+    if ((rc=CheckCreate())!=ERROR_NOERROR) { 
+      return rc;
+    }
+
     newsuperblock.info.rootnode=superblock_index+1;
     newsuperblock.info.freelist=superblock_index+2;
     newsuperblock.info.numkeys=0;
@@ -144,7 +348,8 @@ ERROR_T BTreeIndex::Attach(const SIZE_T initblock, const bool create)
     BTreeNode newrootnode(BTREE_ROOT_NODE,
 			  superblock.info.keysize,
 			  superblock.info.valuesize,
-			  buffercache->GetBlockSize());
+			  buffercache->GetBlockSize(),
+			  superblock.info.format);
     newrootnode.info.rootnode=superblock_index+1;
     newrootnode.info.freelist=superblock_index+2;
     newrootnode.info.numkeys=0;
@@ -161,7 +366,8 @@ ERROR_T BTreeIndex::Attach(const SIZE_T initblock, const bool create)
       BTreeNode newfreenode(BTREE_UNALLOCATED_BLOCK,
 			    superblock.info.keysize,
 			    superblock.info.valuesize,
-			    buffercache->GetBlockSize());
+			    buffercache->GetBlockSize(),
+			    superblock.info.format);
       newfreenode.info.rootnode=superblock_index+1;
       newfreenode.info.freelist= ((i+1)==buffercache->GetNumBlocks()) ? 0: i+1;
       
@@ -176,14 +382,123 @@ ERROR_T BTreeIndex::Attach(const SIZE_T initblock, const bool create)
 
   // OK, now, mounting the btree is simply a matter of reading the superblock 
 
-  return superblock.Unserialize(buffercache,initblock);
+  rc=superblock.Unserialize(buffercache,initblock);
+
+  if (rc) { 
+    return rc;
+  }
+
+  // and picking the fastest node code for its key size and shape.
+  // The kernels compare in binary order, so an index in any other
+  // order searches in it instead.
+  shape=nodeshape_choose(superblock.info);
+  if (superblock.info.keyorder.order!=KEYORDER_BINARY) { 
+    keyorder=&superblock.info.keyorder;
+    keysearch=0;
+  } else {
+    keyorder=0;
+    keysearch=keysearch_choose(superblock.info.keysize);
+    if (keysearch==0 && shape) { 
+      keysearch=shape->search;
+    }
+  }
+  keycodec= superblock.info.keycodec.codec!=KEYCODEC_NONE ? &superblock.info.keycodec : 0;
+  // Descents start out interpolating, until the statistics of
+  // how that goes say otherwise
+  searchstats=KeySearchStats();
+
+  return ERROR_NOERROR;
 }
     
 
+ERROR_T BTreeIndex::CheckCreate(const char **why) const
+{
+  BTreeNode newsuperblock(BTREE_SUPERBLOCK,
+			  superblock.info.keysize,
+			  superblock.info.valuesize,
+			  buffercache->GetBlockSize(),
+			  superblock.info.format);
+  newsuperblock.info.keyorder=superblock.info.keyorder;
+  newsuperblock.info.keycodec=superblock.info.keycodec;
+
+  const char *problem=0;
+  ERROR_T rc=ERROR_NOERROR;
+
+  if ((newsuperblock.info.keycodec.codec!=KEYCODEC_NONE || 
+       newsuperblock.info.format==BTREE_FORMAT_FOR) && 
+      newsuperblock.info.keyorder.order!=KEYORDER_BINARY) { 
+    problem= newsuperblock.info.keycodec.codec!=KEYCODEC_NONE ?
+      "packed keys are in binary order" : "FOR keys are in binary order";
+    rc=ERROR_BADCONFIG;
+  } else if ((problem=newsuperblock.info.SizesProblem())!=0) { 
+    rc=ERROR_SIZE;
+  }
+  if (why) { 
+    *why=problem;
+  }
+  return rc;
+}
+
 ERROR_T BTreeIndex::Detach(SIZE_T &initblock)
 {
   return superblock.Serialize(buffercache,superblock_index);
 }
+
+
+ERROR_T BTreeIndex::Grow(const SIZE_T newblocks)
+{
+  ERROR_T rc;
+  SIZE_T  oldblocks=buffercache->GetNumBlocks();
+
+  if ((rc=buffercache->Grow(newblocks))!=ERROR_NOERROR) { 
+    return rc;
+  }
+
+  SIZE_T numblocks=buffercache->GetNumBlocks();
+
+  if (numblocks==oldblocks) { 
+    return ERROR_NOERROR;
+  }
+
+  // The new blocks go into the free list right after its first
+  // block, so we never walk the list, and the head stays where it is
+  // (it used to be how the root was known to be a leaf).
+  // If the list is empty, the new blocks become the list.
+  SIZE_T rest=0;
+
+  if (superblock.info.freelist!=0) { 
+    BTreeNode head;
+    if ((rc=head.Unserialize(buffercache,superblock.info.freelist))!=ERROR_NOERROR) { 
+      return rc;
+    }
+    rest=head.info.freelist;
+    head.info.freelist=oldblocks;
+    if ((rc=head.Serialize(buffercache,superblock.info.freelist))!=ERROR_NOERROR) { 
+      return rc;
+    }
+  } else {
+    superblock.info.freelist=oldblocks;
+    if ((rc=superblock.Serialize(buffercache,superblock_index))!=ERROR_NOERROR) { 
+      return rc;
+    }
+  }
+
+  for (SIZE_T i=oldblocks; i<numblocks;i++) { 
+    BTreeNode newfreenode(BTREE_UNALLOCATED_BLOCK,
+			  superblock.info.keysize,
+			  superblock.info.valuesize,
+			  buffercache->GetBlockSize(),
+			  superblock.info.format);
+    newfreenode.info.rootnode=superblock.info.rootnode;
+    newfreenode.info.freelist= ((i+1)==numblocks) ? rest : i+1;
+      
+    if ((rc=newfreenode.Serialize(buffercache,i))!=ERROR_NOERROR) { 
+      return rc;
+    }
+  }
+
+  return ERROR_NOERROR;
+}
  
 
 ERROR_T BTreeIndex::LookupOrUpdateInternal(const SIZE_T &node,
@@ -191,63 +506,91 @@ ERROR_T BTreeIndex::LookupOrUpdateInternal(const SIZE_T &node,
 					   const KEY_T &key,
 					   VALUE_T &value)
 {
-  BTreeNode b;
+  // Look at the node in place in the cache; only an update makes a copy
+  BTreeNodeView b;
   ERROR_T rc;
   SIZE_T offset;
-  KEY_T testkey;
-  SIZE_T ptr;
+  SIZE_T block=node;
+  SIZE_T height;
+  int rootLeafFlag = 0;
 
-  rc= b.Unserialize(buffercache,node);
+  // Go down a level at a time to the leaf
+  for (height=0;;height++) { 
+    if (height==BTREE_MAX_HEIGHT) { 
+      return ERROR_INSANE;
+    }
+    rc= b.View(buffercache,block);
 
-  if (rc!=ERROR_NOERROR) { 
-    return rc;
-  }
-  int rootLeafFlag = 0;
-  if(superblock.info.freelist==2 and b.info.nodetype == BTREE_ROOT_NODE)
-  {
-  	rootLeafFlag = 1;
-  	b.info.nodetype = BTREE_LEAF_NODE;
-  }
-  switch (b.info.nodetype) { 
-  case BTREE_ROOT_NODE:
-  case BTREE_INTERIOR_NODE:
-    // Scan through key/ptr pairs
-    //and recurse if possible
-    for (offset=0;offset<b.info.numkeys;offset++) { 
-      rc=b.GetKey(offset,testkey);
-      if (rc) {  return rc; }
-      if (key<testkey || key==testkey) {
-	// OK, so we now have the first key that's larger
-	// so we ned to recurse on the ptr immediately previous to 
-	// this one, if it exists
-	rc=b.GetPtr(offset,ptr);
-	if (rc) { return rc; }
-	return LookupOrUpdateInternal(ptr,op,key,value);
-      }
+    if (rc!=ERROR_NOERROR) { 
+      return rc;
     }
-    // if we got here, we need to go to the next pointer, if it exists
-    if (b.info.numkeys>0) { 
-      rc=b.GetPtr(b.info.numkeys,ptr);
-      if (rc) { return rc; }
-      return LookupOrUpdateInternal(ptr,op,key,value);
-    } else {
+    if(RootIsLeaf() and b.info.nodetype == BTREE_ROOT_NODE)
+    {
+    	rootLeafFlag = 1;
+    	b.info.nodetype = BTREE_LEAF_NODE;
+    }
+    if (b.info.nodetype!=BTREE_ROOT_NODE && b.info.nodetype!=BTREE_INTERIOR_NODE) { 
+      break;
+    }
+    if (b.info.numkeys==0) { 
       // There are no keys at all on this node, so nowhere to go
       return ERROR_NONEXISTENT;
     }
-    break;
+    // Find the first key that's larger and go down the 
+    // ptr immediately previous to it (the last ptr if there is none)
+    offset=b.FindChild(key,keysearch,keyorder,&searchstats);
+    rc=b.GetPtr(offset,block);
+    if (rc) { return rc; }
+    b.Release();
+  }
+
+  switch (b.info.nodetype) { 
   case BTREE_LEAF_NODE:
-    // Scan through keys looking for matching value
-    for (offset=0;offset<b.info.numkeys;offset++) { 
-      rc=b.GetKey(offset,testkey);
-      if (rc) {  return rc; }
-      if (testkey==key) { 
+    // Search the keys for a match
+    offset=b.FindKey(key,keysearch,keyorder,&searchstats);
+    if (offset<b.info.numkeys) { 
+      if (b.CompareKey(offset,key,keyorder)==0) { 
 	if (op==BTREE_OP_LOOKUP) { 
+		SIZE_T chain, length;
+		if (b.GetOverflow(offset,chain,length)==ERROR_NOERROR) { 
+			b.Release();
+			return ReadOverflow(buffercache,chain,length,value);
+		}
 		return b.GetVal(offset,value);
 	} else { 
-	  rc= b.SetVal(offset,value);
+	  b.Release();
+	  BTreeNode n;
+	  rc= n.Unserialize(buffercache,block);
 	  if(rc){return rc;}
-	  if(rootLeafFlag){b.info.nodetype = BTREE_ROOT_NODE;}
-	  return b.Serialize(buffercache,node);
+	  if(rootLeafFlag){n.info.nodetype = BTREE_LEAF_NODE;}
+	  // an out of line value that is replaced is freed once the
+	  // new one is in
+	  SIZE_T oldChain=0, oldLength=0;
+	  n.GetOverflow(offset,oldChain,oldLength);
+	  rc= SetLeafVal(n,offset,value);
+	  if(rc==ERROR_NOSPACE){
+	    // A longer value doesn't fit in this SLOTTED leaf, so take
+	    // the key out and insert it again, splitting the leaf, or
+	    // put the leaf back as it was if that fails
+	    BTreeNode without(n);
+	    rc= without.RemoveSlot(offset,shape);
+	    if(rc){return rc;}
+	    if(rootLeafFlag){without.info.nodetype = BTREE_ROOT_NODE;}
+	    rc= without.Serialize(buffercache,block);
+	    if(rc){return rc;}
+	    rc= InsertInternal(superblock.info.rootnode,key,value);
+	    if(rc){
+	      if(rootLeafFlag){n.info.nodetype = BTREE_ROOT_NODE;}
+	      n.Serialize(buffercache,block);
+	      return rc;
+	    }
+	    return oldChain ? FreeOverflow(oldChain) : ERROR_NOERROR;
+	  }
+	  if(rc){return rc;}
+	  if(rootLeafFlag){n.info.nodetype = BTREE_ROOT_NODE;}
+	  rc= n.Serialize(buffercache,block);
+	  if(rc){return rc;}
+	  return oldChain ? FreeOverflow(oldChain) : ERROR_NOERROR;
 	}     
       }
     }
@@ -263,61 +606,57 @@ ERROR_T BTreeIndex::LookupOrUpdateInternal(const SIZE_T &node,
 }
 
 
-ERROR_T	BTreeIndex::InsertFindNode(const SIZE_T &Node, const KEY_T &key, const VALUE_T &value, list<SIZE_T> &Path) const
+ERROR_T	BTreeIndex::InsertFindNode(const SIZE_T &Node, const KEY_T &key, BTreePath &Path) const
 {
-  BTreeNode b;
   ERROR_T rc;
-  SIZE_T offset;
-  KEY_T testkey;
-  SIZE_T ptr;
+  SIZE_T block=Node;
 
-  rc= b.Unserialize(buffercache,Node);
-  Path.push_back(Node);
+  Path.height=0;
 
-  // cout << "**Pushed onto path: "<<Node<<endl;
-  if (rc!=ERROR_NOERROR) { 
-    return rc;
-  }
+  // Go down a level at a time to the leaf, keeping each node, decoded,
+  // for the insert and any split to work from, and the pointer 
+  // followed out of it
+  while (true) { 
+    if (Path.height==BTREE_MAX_HEIGHT) { 
+      return ERROR_INSANE;
+    }
+    BTreePathNode &level=Path.level[Path.height++];
+    BTreeNode &b=level.node;
+    level.block=block;
+    level.slot=0;
 
-  switch (b.info.nodetype) { 
-  case BTREE_ROOT_NODE:
-	if(superblock.info.freelist == 2){
-		return ERROR_NOERROR;
-	}
+    rc= b.Unserialize(buffercache,block);
 
-  case BTREE_INTERIOR_NODE:
-    // Scan through key/ptr pairs
-    //and recurse if possible
-    for (offset=0;offset<b.info.numkeys;offset++) { 
-      rc=b.GetKey(offset,testkey);
-      if (rc) {  return rc; }
-      if (key<testkey || key==testkey) {
-	// OK, so we now have the first key that's larger
-	// so we ned to recurse on the ptr immediately previous to 
-	// this one, if it exists
-	rc=b.GetPtr(offset,ptr);
-	if (rc) { return rc; }
-	return InsertFindNode(ptr,key,value,Path);
-      }
-    }
-    // if we got here, we need to go to the next pointer, if it exists
-    if (b.info.numkeys>0) { 
-      rc=b.GetPtr(b.info.numkeys,ptr);
-      if (rc) { return rc; }
-      return InsertFindNode(ptr,key,value,Path);
-    } else {
-      // There are no keys at all on this node, so nowhere to go
-      return ERROR_NONEXISTENT;
+    if (rc!=ERROR_NOERROR) { 
+      return rc;
     }
-    break;
-  case BTREE_LEAF_NODE:
+
+    switch (b.info.nodetype) { 
+    case BTREE_ROOT_NODE:
+      if(RootIsLeaf()){
 	return ERROR_NOERROR;
-    break;
-  default:
-    // We can't be looking at anything other than a root, internal, or leaf
-    return ERROR_INSANE;
-    break;
-  }  
+      }
+
+    case BTREE_INTERIOR_NODE:
+      if (b.info.numkeys==0) { 
+	// There are no keys at all on this node, so nowhere to go
+	return ERROR_NONEXISTENT;
+      }
+      // Find the first key that's larger and go down the 
+      // ptr immediately previous to it (the last ptr if there is none)
+      level.slot=b.FindChild(key,keysearch,keyorder,&searchstats);
+      rc=b.GetPtr(level.slot,block);
+      if (rc) { return rc; }
+      break;
+    case BTREE_LEAF_NODE:
+      return ERROR_NOERROR;
+      break;
+    default:
+      // We can't be looking at anything other than a root, internal, or leaf
+      return ERROR_INSANE;
+      break;
+    }  
+  }
 
   return ERROR_INSANE;
 }
@@ -326,275 +665,240 @@ ERROR_T	BTreeIndex::InsertFindNode(const SIZE_T &Node, const KEY_T &key, const V
 //
 //
 //
-bool BTreeIndex::isFull(const SIZE_T &Node) const
+
+// Turn sep, the first key of the right half of a split leaf, into
+// the shortest zero padded key that still separates it from left, the
+// last key of the left half: everything after the first byte where
+// they differ becomes zero.  It's still greater than left and no
+// greater than the right half's keys, and it pads away in PREFIX
+// interior nodes (see btree_ds.h).  Where keys can be shorter 
+// (SLOTTED) the rest is cut off instead.  This is only so in binary
+// order (see keyorder.h).
+static void ShortenSeparator(const KEY_T &left, KEY_T &sep, const bool cut)
 {
-	// Checks if a given node is full
-	BTreeNode b; 
-	b.Unserialize(buffercache, Node);
-	switch(b.info.nodetype)
-	{
-		case BTREE_ROOT_NODE:
-		case BTREE_INTERIOR_NODE:
-		{
-			return (b.info.GetNumSlotsAsInterior() == b.info.numkeys);
-			break;
+	SIZE_T i=0;
+	while (i<sep.length && i<left.length && sep.data[i]==left.data[i]) { 
+		i++;
+	}
+	if (i+1<sep.length) { 
+		if (cut) { 
+			sep.Resize(i+1);
+		} else {
+			memset(sep.data+i+1,0,sep.length-i-1);
 		}
-		case BTREE_LEAF_NODE:
-		{
-			return (b.info.GetNumSlotsAsLeaf() == b.info.numkeys);
-			break;
+	}
+}
+
+// The separator to push up after splitting leaf left into left and
+// right: the first key of right, shortened if the index is in binary
+// order (and before it's packed, if the index packs its keys)
+ERROR_T BTreeIndex::SplitSeparator(const BTreeNode &left, const BTreeNode &right, KEY_T &sep) const
+{
+	ERROR_T rc;
+	KEY_T last;
+
+	if ((rc=left.GetKey(left.info.numkeys-1,last)) || (rc=right.GetKey(0,sep))) { 
+		return rc;
+	}
+	if (keyorder!=0) { 
+		return ERROR_NOERROR;
+	}
+	if (keycodec) { 
+		// shorten the keys as the index's users see them, so that the
+		// separator unpacks to a whole key too, and pad it back out
+		// to the stored width if keys are all one size
+		KEY_T l, r;
+		SIZE_T width=sep.length;
+		keycodec->Unpack((const char*)last.data,last.length,l);
+		keycodec->Unpack((const char*)sep.data,sep.length,r);
+		ShortenSeparator(l,r,true);
+		if ((rc=keycodec->Pack(r,sep))) { 
+			return rc;
 		}
-		default:
-		{
-			// no such nodetype
-			return true;
-			break;
+		if (left.info.format!=BTREE_FORMAT_SLOTTED && sep.length<width) { 
+			SIZE_T packed=sep.length;
+			sep.Resize(width);
+			memset(sep.data+packed,0,width-packed);
 		}
+		return ERROR_NOERROR;
 	}
-	return false;
+	ShortenSeparator(last,sep,left.info.format==BTREE_FORMAT_SLOTTED);
+	return ERROR_NOERROR;
 }
 
-
-ERROR_T BTreeIndex::InsertAndSplitLeaf(SIZE_T &L1, SIZE_T &L2, const KEY_T &k, const VALUE_T &v){
-	// distribute keys from one leaf to two keys and then insert the new key/val pair
-	BTreeNode original;
-	BTreeNode newLeaf;
-	
+ERROR_T BTreeIndex::InsertAndSplitLeaf(BTreeNode &original, BTreeNode &newLeaf, const SIZE_T &at, const KEY_T &k, const VALUE_T &v){
+	// distribute keys from a full leaf between it and newLeaf, an empty
+	// one, and then insert the new key/val pair where the at'th key of
+	// the full leaf was.  Neither is written back here.
 	ERROR_T rc;
 	
-	rc = original.Unserialize(buffercache,L1);
-	if (rc){return rc;}
-	
 	SIZE_T firstHalfOfKeys;
 	SIZE_T secondHalfOfKeys;
 	
 	// find the index to split on
-	firstHalfOfKeys = floor((original.info.numkeys + 1)/2);
-	secondHalfOfKeys = ceil((original.info.numkeys + 1)/2);
+	firstHalfOfKeys = original.GetSplitOffset();
+	secondHalfOfKeys = original.info.numkeys - firstHalfOfKeys;
 	
-	// read the new leaf from disk
-	rc = newLeaf.Unserialize(buffercache, L2);
 	// set the new leaf's num of keys
 	newLeaf.info.numkeys = secondHalfOfKeys;
 	
-	if(rc){return rc;}
-	
-	KEY_T tempKey;
 	SIZE_T offset;
-	KEY_T newKey;
-	VALUE_T newVal;
+	KeyValuePair newKV;
 	
 	// split the node into two leaves
 	for (offset = firstHalfOfKeys; offset < original.info.numkeys;offset++)
 	{
 		
 		// get from old leaf
-		rc = original.GetKey(offset, newKey);
-		rc = original.GetVal(offset, newVal);
+		rc = original.GetKeyVal(offset, newKV);
 		if(rc){return rc;}
 		
-		// put into new leaf
-		rc = newLeaf.SetKey(offset-firstHalfOfKeys,newKey);
-		rc = newLeaf.SetVal(offset-firstHalfOfKeys, newVal);
+		// put into new leaf, still out of line if it was
+		SIZE_T chain, length;
+		if (original.GetOverflow(offset,chain,length)==ERROR_NOERROR) { 
+			rc = newLeaf.SetKeyOverflow(offset-firstHalfOfKeys,newKV.key,chain,length);
+		} else {
+			rc = newLeaf.SetKeyVal(offset-firstHalfOfKeys,newKV);
+		}
 		if(rc){return rc;}
 	}
 	// set the original leaf's numkeys
 	original.info.numkeys = firstHalfOfKeys;
 	
-	// now find where to put the new key and value
-	rc = original.GetKey(firstHalfOfKeys - 1,tempKey);
-	if(rc){return rc;}
-	
-	// write the nodes back to disk
-	rc = original.Serialize(buffercache, L1);
-	if(rc){return rc;}
-	rc = newLeaf.Serialize(buffercache,L2);
-	if(rc){return rc;}
-	
-	if (k < tempKey || k == tempKey)
+	// now put the new key and value where it goes: k is no greater 
+	// than the last key of the first leaf if it goes before it
+	if (at < firstHalfOfKeys)
 	{
 		// we need to add our key to the first leaf
-		rc = FindAndInsertKeyVal(L1,k,v);
+		return InsertKeyVal(original,at,k,v);
 	}
 	else
 	{	
 		// we need to add our key to the second leaf
-		rc = FindAndInsertKeyVal(L2,k,v);
+		return InsertKeyVal(newLeaf,at-firstHalfOfKeys,k,v);
 	}
-	if(rc){return rc;}
-	
-	return ERROR_NOERROR;
 	
 }
 
-ERROR_T BTreeIndex::InsertRecur(list<SIZE_T> &path, const KEY_T &k , const SIZE_T &ptr)
+ERROR_T BTreeIndex::InsertIntoParents(BTreePath &path, const KEY_T &key, const SIZE_T &ptr)
 {
-	SIZE_T p = path.back();
-	path.pop_back();
+	// Split node path.level[height-1] has a new right sibling, ptr,
+	// separated from it by key.  Put them in its parent, which has
+	// room for them in the slot after the pointer the descent
+	// followed, splitting it too if it's full, and so on up.
+	KEY_T k(key);
+	SIZE_T right = ptr;
 	ERROR_T rc;
-	// pull the parent from the path
-	BTreeNode parent;
-	// read it from disk
-	rc = parent.Unserialize(buffercache, p);
-	if(rc){return rc;}
 
-	
-	if(!isFull(p))
+	for (SIZE_T height = path.height-1; height > 0; height--)
 	{
-	//	cout << "I just split the leaves and the parent isn't full"<<endl;
-		// if the parent isn't full 
-		// then we put the first key into parent
-		SIZE_T offset;
-		KEY_T tempKey;
-		SIZE_T saveOffset = parent.info.numkeys;
-		SIZE_T tempPtr;
-		// find where in parent to put the first key
-		for(offset = 0; offset < parent.info.numkeys; offset++)
+		// the parent of the node just split, as the descent read it
+		BTreePathNode &level = path.level[height-1];
+		SIZE_T p = level.block;
+		BTreeNode &parent = level.node;
+
+		// how much a node holds can depend on the key (see btree_ds.h)
+		if(parent.GetNumSlotsWith(k) > parent.info.numkeys)
 		{
-			rc = parent.GetKey(offset, tempKey);
-			if(rc){
-				return rc;
-			}
-			if (k<tempKey || k==tempKey)
-			{
-				saveOffset = offset;
-				break;
-			}	
+			// if the parent isn't full 
+			// then we put the first key into parent
+			rc = InsertKeyPtr(parent, level.slot, k, right);
+			if(rc){return rc;}
+			return parent.Serialize(buffercache,p);
 		}
-		parent.info.numkeys++;
-		// do the movement of keys/ptr to allocate space
-		for(offset = parent.info.numkeys-1; offset > saveOffset; offset--)
+		// if the parent is full and it is the root node 
+		else if(parent.info.nodetype == BTREE_ROOT_NODE)
 		{
-			rc = parent.GetKey(offset-1, tempKey);
-			if(rc)
-			{
-				return rc;
-			}
-			rc = parent.GetPtr(offset, tempPtr);
+			SIZE_T NewInterior;
+			//we need to create a new interior node
+			rc = AllocateNode(NewInterior);
+			if (rc){return rc;}
+			
+			SIZE_T NewRoot;
+			//we need to create a new root node
+			rc = AllocateNode(NewRoot);
+			if (rc){return rc;}
+			
+			// we need to take the parent and newNode and distribute the keys across the two
+			return InsertAndSplitRoot(parent, p, level.slot, NewInterior, NewRoot, k, right);
+		}
+		// if the parent is full and it is an interior node
+		else
+		{
+			SIZE_T NewInterior;
+			// we need to create a new interior node
+			rc = AllocateNode(NewInterior);
+			if (rc){return rc;}
+			BTreeNode newInterior = BTreeNode(BTREE_INTERIOR_NODE, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize, superblock.info.format);
+			
+			// we need to take the parent and newNode and distribute the keys across the two
+			KEY_T newK;
+			rc = InsertAndSplitInterior(parent, newInterior, level.slot, k, right, newK);
 			if(rc){return rc;}
-			rc = parent.SetKey(offset,tempKey);
-			rc = parent.SetPtr(offset + 1,tempPtr);
+			rc = parent.Serialize(buffercache, p);
 			if(rc){return rc;}
+			rc = newInterior.Serialize(buffercache, NewInterior);
+			if(rc){return rc;}
+			// and now the parent has a new right sibling
+			k = newK;
+			right = NewInterior;
 		}
-		rc = parent.SetKey(saveOffset, k);
-		rc = parent.SetPtr(saveOffset + 1, ptr);
-		rc = parent.Serialize(buffercache,p);
-		if(rc){return rc;}
-	}
-	// if the parent is full and it is the root node 
-	else if(parent.info.nodetype == BTREE_ROOT_NODE)
-	{
-		SIZE_T NewInterior;
-		//we need to create a new interior node
-		rc = AllocateNode(NewInterior);
-		
-		SIZE_T NewRoot;
-		//we need to create a new root node
-		rc = AllocateNode(NewRoot);
-		
-		BTreeNode newInterior = BTreeNode(BTREE_INTERIOR_NODE, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize);
-		newInterior.Serialize(buffercache, NewInterior);
-		
-		BTreeNode newRoot = BTreeNode(BTREE_ROOT_NODE, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize);
-		newRoot.Serialize(buffercache, NewRoot);
-		
-		superblock.info.rootnode = NewRoot;
-		superblock.Serialize(buffercache, superblock_index);
-		if (rc){return rc;}
-		
-		// we need to take the parent and newNode and distribute the keys across the two
-		rc = InsertAndSplitRoot(p, NewInterior, NewRoot, k, ptr);
-		if(rc){return rc;}
 	}
-	// if the parent is full and it is an interior node
-	else
-	{
-		SIZE_T NewInterior;
-		// we need to create a new interior node
-		rc = AllocateNode(NewInterior);
-		BTreeNode newInterior = BTreeNode(BTREE_INTERIOR_NODE, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize);
-		newInterior.Serialize(buffercache, NewInterior);
-		
-		if (rc){return rc;}
-		// we need to take the parent and newNode and distribute the keys across the two
-		KEY_T newK;
-		rc = InsertAndSplitInterior(p, NewInterior, k, ptr, newK);
-		rc = InsertRecur(path, newK, NewInterior);
-		if(rc){return rc;}
-	}
-	return ERROR_NOERROR;
+	// only the root has no parent, and it's never split above
+	return ERROR_INSANE;
 }
 
-ERROR_T BTreeIndex::InsertAndSplitRoot(SIZE_T &p, SIZE_T &NewInterior, SIZE_T &NewRoot, const KEY_T &k, const SIZE_T &ptr){
+ERROR_T BTreeIndex::InsertAndSplitRoot(BTreeNode &root, const SIZE_T &p, const SIZE_T &at, const SIZE_T &NewInterior, const SIZE_T &NewRoot, const KEY_T &k, const SIZE_T &ptr){
 	ERROR_T rc;
 	KEY_T key;
 	//Insert key and val into current root, return pushed up key and pointer to new internal node
-	rc = InsertAndSplitInterior(p,NewInterior,k,ptr,key);
+	BTreeNode b2 = BTreeNode(BTREE_INTERIOR_NODE, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize, superblock.info.format);
+	rc = InsertAndSplitInterior(root,b2,at,k,ptr,key);
 	if(rc){return rc;}
 
 
-	BTreeNode bNewRoot;
-	rc = bNewRoot.Unserialize(buffercache, NewRoot);
-	if(rc){return rc;}
+	BTreeNode bNewRoot = BTreeNode(BTREE_ROOT_NODE, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize, superblock.info.format);
 	bNewRoot.info.numkeys++;
 	bNewRoot.SetKey(0,key);
 	bNewRoot.SetPtr(0, p);
 	bNewRoot.SetPtr(1, NewInterior);
 	
+	root.info.nodetype = BTREE_INTERIOR_NODE;
 
-	BTreeNode b;
-	rc = b.Unserialize(buffercache, p);
-        BTreeNode b2;
-        rc = b2.Unserialize(buffercache, NewInterior);
-
-	b.info.nodetype = BTREE_INTERIOR_NODE;
-	b2.info.nodetype = BTREE_INTERIOR_NODE;
-	bNewRoot.info.nodetype = BTREE_ROOT_NODE;
-
-	rc = b.Serialize(buffercache, p);
-	rc = b2.Serialize(buffercache, NewInterior);
-	rc = bNewRoot.Serialize(buffercache, NewRoot);
+	if ((rc = root.Serialize(buffercache, p)) ||
+	    (rc = b2.Serialize(buffercache, NewInterior)) ||
+	    (rc = bNewRoot.Serialize(buffercache, NewRoot))) { 
+		return rc;
+	}
 	superblock.info.rootnode = NewRoot;
-	superblock.Serialize(buffercache, superblock_index);
-	
-        return rc;
+	return superblock.Serialize(buffercache, superblock_index);
 }
 
 
-ERROR_T BTreeIndex::InsertAndSplitInterior(SIZE_T &I1,
-					   SIZE_T &I2,
+ERROR_T BTreeIndex::InsertAndSplitInterior(BTreeNode &original,
+					   BTreeNode &newInterior,
+					   const SIZE_T &at,
 					   const KEY_T &k,
 					   const SIZE_T &ptr,
 					   KEY_T &newK)
 {
-        // Distribute keys and pointers of I1, plus new one, into I1 and I2 (except for middle)
+        // Distribute keys and pointers of original, plus new one, which
+        // goes where its at'th key was, with ptr after it, into
+        // original and newInterior, an empty one (except for middle, 
+        // which is newK).  Neither is written back here.
 
-        BTreeNode original;
-        BTreeNode newInterior;
         ERROR_T rc;
-        
-        rc = original.Unserialize(buffercache, I1);
-       	if(rc){return rc;}
-       	rc = newInterior.Unserialize(buffercache, I2);
-       	if(rc){return rc;}
        	
        	SIZE_T firstHalfOfKeys;
 	SIZE_T secondHalfOfKeys;
-	SIZE_T firstHalfOfptrs;
-	SIZE_T secondHalfOfptrs;
 	
 	// find the index to split on
-	firstHalfOfKeys = ceil((original.info.numkeys) / 2);
-	secondHalfOfKeys = floor((original.info.numkeys) / 2);
-	
-	firstHalfOfptrs = ceil((original.info.numkeys + 2) / 2);
-	secondHalfOfptrs = floor((original.info.numkeys + 2) / 2);
+	firstHalfOfKeys = original.GetSplitOffset();
+	secondHalfOfKeys = original.info.numkeys - firstHalfOfKeys;
 	
 	// set the new leaf's num of keys
 	newInterior.info.numkeys = secondHalfOfKeys;
 	
-	if(rc){return rc;}
-	
 	SIZE_T offset;
 	
 	SIZE_T tempPtr;
@@ -620,352 +924,177 @@ ERROR_T BTreeIndex::InsertAndSplitInterior(SIZE_T &I1,
        	
        	original.info.numkeys = firstHalfOfKeys;
        	
-       	// now find where to put the new key and value
-	rc = original.GetKey(firstHalfOfKeys - 1,tempKey);
-	if(rc){return rc;}
-	
-	// write the nodes back to disk
-	rc = original.Serialize(buffercache, I1);
-	if(rc){return rc;}
-	rc = newInterior.Serialize(buffercache,I2);
-	if(rc){return rc;}
-	
-	// insert our key and ptr into the correct 
-	if(k < tempKey || k == tempKey)
+	// insert our key and ptr into the correct node
+	if(at < firstHalfOfKeys)
 	{
-		rc = FindAndInsertKeyPtr(I1,k,ptr);
+		rc = InsertKeyPtr(original,at,k,ptr);
 	}
 	else
 	{
-		rc = FindAndInsertKeyPtr(I2,k,ptr);
+		rc = InsertKeyPtr(newInterior,at-firstHalfOfKeys,k,ptr);
 	}
-	// send the last key of I1 to InsertRecur
-	BTreeNode b;
-	rc = b.Unserialize(buffercache, I1);
-	rc = b.GetKey(b.info.numkeys-1, newK);
-	b.info.numkeys--;
-	rc = b.Serialize(buffercache, I1);
+	if(rc){return rc;}
+	// send the last key of original up to InsertIntoParents
+	rc = original.GetKey(original.info.numkeys-1, newK);
+	original.info.numkeys--;
 	return rc;
         
 }
 
 
-ERROR_T BTreeIndex::FindAndInsertKeyVal(SIZE_T &Node, const KEY_T &key, const VALUE_T &val)
+ERROR_T BTreeIndex::InsertKeyVal(BTreeNode &b, const SIZE_T &offset, const KEY_T &key, const VALUE_T &val)
 {
-	// find the place to insert a new key
-	BTreeNode b;
-	ERROR_T rc;
-	rc = b.Unserialize(buffercache, Node);
-	if (rc){return rc;}
-	
-	SIZE_T offset;
-	KEY_T tempKey;
-	SIZE_T saveOffset = b.info.numkeys;
-	KeyValuePair swapKV;
-	VALUE_T tempVal;
-	
-	// find the place to put the key
-	for(offset = 0; offset < b.info.numkeys; offset++)
-	{
-		rc = b.GetKey(offset, tempKey);
-		if(rc){
-			return rc;
-		}
-		if (key<tempKey || key==tempKey)
-		{
-			saveOffset = offset;
-			break;
-		}	
-	}
-	
-	b.info.numkeys++;
 	// move the keys down to allocate space for the new key
-	for(offset = b.info.numkeys-1; offset > saveOffset; offset--)
-	{
-		rc = b.GetKey(offset-1, tempKey);
-		if(rc)
-		{
-			return rc;
-		}
-		rc = b.GetVal(offset-1, tempVal);
-		if (rc)
-		{
-			return rc;	
-		}
-		swapKV = KeyValuePair(tempKey, tempVal);
-		rc = b.SetKeyVal(offset, swapKV);
-       		if(rc)
-       		{
-        		return rc;
-		}
-	}
-	// put the new key in
-	
-	swapKV = KeyValuePair(key,val);
-	rc = b.SetKeyVal(saveOffset, swapKV);
-	
-	rc = b.Serialize(buffercache, Node);
-	if(rc){ return rc;}
-	
+	ERROR_T rc = b.InsertSlot(offset,shape);
+	if(rc){return rc;}
 
-	return ERROR_NOERROR;
-	
+	// put the new key in
+	return SetLeafKeyVal(b,offset, KeyValuePair(key,val));
 }
 
-ERROR_T BTreeIndex::FindAndInsertKeyPtr(SIZE_T &Node, const KEY_T &key, const SIZE_T &ptr)
+ERROR_T BTreeIndex::InsertKeyPtr(BTreeNode &b, const SIZE_T &offset, const KEY_T &key, const SIZE_T &ptr)
 {
-	// find the place to insert a new key
-	BTreeNode b;
-	ERROR_T rc;
-	rc = b.Unserialize(buffercache, Node);
-	if (rc){return rc;}
-	
-	SIZE_T offset;
-	KEY_T tempKey;
-	SIZE_T saveOffset = b.info.numkeys;
-	SIZE_T tempPtr;
-	
-	// find the place to put the key
-	for(offset = 0; offset < b.info.numkeys; offset++)
-	{
-		rc = b.GetKey(offset, tempKey);
-		if(rc){
-			return rc;
-		}
-		if (key<tempKey || key==tempKey)
-		{
-			saveOffset = offset;
-			break;
-		}	
-	}
-	b.info.numkeys++;
-	// move the keys down to allocate space for the new key
-	for(offset = b.info.numkeys-1; offset > saveOffset; offset--)
-	{
-		// get the key and ptr
-		rc = b.GetKey(offset-1, tempKey);
-		rc = b.GetPtr(offset, tempPtr);
-		if (rc){return rc;}
-		
-		// move them down one from its original spot
-		rc = b.SetKey(offset, tempKey);
-		rc = b.SetPtr(offset+1, tempPtr);
-       		
-       		if(rc){return rc;}
-	}
-	
-	rc = b.SetKey(saveOffset,key);
-	rc = b.SetPtr(saveOffset + 1,ptr);
+	// move the keys (and the pointers after them) down to allocate 
+	// space for the new key
+	ERROR_T rc = b.InsertSlot(offset,shape);
+	if(rc){return rc;}
 	
-	rc = b.Serialize(buffercache, Node);
+	rc = b.SetKey(offset,key);
 	if(rc){return rc;}
-
-	return ERROR_NOERROR;
+	return b.SetPtr(offset + 1,ptr);
 }
 
 ERROR_T BTreeIndex::InsertInternal(const SIZE_T &Node, const KEY_T &key, const VALUE_T &val)
 {
 
 	ERROR_T rc;
-	list<SIZE_T> Path;
-	// Find the node where the key should be inserted (i.e. leaf node)
-	rc = InsertFindNode(Node, key, val, Path);
+	// Find the node where the key should be inserted (i.e. leaf node),
+	// keeping each node on the way as it's read.  The insert, and any
+	// splits up the path, work from these, so each is read only once.
+	BTreePath Path;
+	rc = InsertFindNode(Node, key, Path);
+	if(rc){return rc;}
 	
 	// Get the node that we to insert into from the Path
-	SIZE_T L = Path.back();
-//	cout << L <<endl;	
+	SIZE_T L = Path.level[Path.height-1].block;
+	BTreeNode &b = Path.level[Path.height-1].node;
+
+	// if it's the root acting as a leaf, we change its type temporarily
+	// so that keys and values are laid out as in a leaf
+	bool rootLeaf = isRootLeaf(b);
+	if(rootLeaf){
+		b.info.nodetype = BTREE_LEAF_NODE;
+	}
 
-	// remove from path the node we insert into
-	Path.pop_back();
-	BTreeNode b;
+	// search for the location to put the key, which is where it is
+	// if it's already there
+	SIZE_T saveOffset = b.FindKey(key,keysearch,keyorder,&searchstats);
+	if(saveOffset < b.info.numkeys && b.CompareKey(saveOffset,key,keyorder)==0){
+		// we found a duplicate
+		return ERROR_CONFLICT;
+	}
 
-	// If L is not full (i.e. the node we insert into)
-	if(!isFull(L)){
-	//	cout << "**Node not full" << endl;		
+	// If L is not full (i.e. the node we insert into); how much a
+	// node holds can depend on the key (see btree_ds.h)
+	if(b.GetNumSlotsWith(key) > b.info.numkeys){
 		
-		// read data from node
-		rc = b.Unserialize(buffercache, L);
-
-		SIZE_T offset;
-		SIZE_T saveOffset = b.info.numkeys;
-		KEY_T tempKey;
-		const KeyValuePair kv = KeyValuePair(key, val);
-		KeyValuePair swapKV;
-		VALUE_T tempVal;
-
-	//	cout << "**Num keys in this node: " << b.info.numkeys << "/"<< b.info.GetNumSlotsAsLeaf()<<endl;		
+		// shift the keys after it up, and insert our new key/val
+		rc = InsertKeyVal(b,saveOffset,key,val);
+		if(rc){return rc;}
 		
-		// search for the location to put the key
-		for(offset = 0; offset<b.info.numkeys; offset++){
-			rc = b.GetKey(offset, tempKey);
-			if(rc){
-				return rc;
-			}
-			if (key<tempKey || key==tempKey)
-			{
-				saveOffset = offset;
-				break;
-			}
+		if(rootLeaf){
+			b.info.nodetype = BTREE_ROOT_NODE;
 		}
-
-	//	cout << "**Inserting at position: " << saveOffset << endl;
-
-		// increment the number of keys in the node
-		b.info.numkeys++;
 		
-		// go through the keys and shift accordingly to allocate space for the new key
-		for(offset = b.info.numkeys-1; offset > saveOffset; offset--)
-		{
-		//	cout << "**Moving key at position "<<offset-1<<" to position "<< offset <<endl;		
+		// write the data back to the disk
+		return b.Serialize(buffercache, L);
+	}
 
-			rc = b.GetKey(offset-1, tempKey);
-			if(rc){return rc;}
+	// the node we want to insert into is full 
 
-			// if it's the root acting as a leaf, we change its type temporarily so GetVal doesn't freak out
-                        if(isRootLeaf(b)){
-                                b.info.nodetype = BTREE_LEAF_NODE;
-                                
-                                rc = b.GetVal(offset-1, tempVal);
-                                if(rc){return rc;}
-                                
-                                swapKV = KeyValuePair(tempKey, tempVal);
-                                rc = b.SetKeyVal(offset, swapKV);
-                                
-                                b.info.nodetype = BTREE_ROOT_NODE;
-                        }else{
-	                        rc = b.GetVal(offset-1, tempVal);
-	                        if(rc){return rc;}
-	                        
-	                        swapKV = KeyValuePair(tempKey, tempVal);
-	                        rc = b.SetKeyVal(offset, swapKV);
-			}
-			if(rc){return rc;}
-		}
+	// The split may go all the way up and add a new root, 
+	// allocating a node at every level.  Fail now if the free
+	// list can't cover that, before anything is changed, so the
+	// caller can Grow and try again.  An out of line value
+	// takes its blocks too.
+	if(!HaveFreeNodes(Path.height+1+OverflowBlocks(val))){
+		return ERROR_NOSPACE;
+	}
 
-		// Now that we've made room, insert our new key/val
-		// if it's the root acting as a leaf, we change its type temporarily so SetKeyVal allows it
-		if(isRootLeaf(b)){
-			b.info.nodetype = BTREE_LEAF_NODE;
-			rc = b.SetKeyVal(saveOffset, kv);
-			b.info.nodetype = BTREE_ROOT_NODE;
-		//	cout << "**Inserted into rootleaf"<<endl;
-		}else{
-			rc = b.SetKeyVal(saveOffset, kv);
-		}
+	BTreeNode newLeaf = BTreeNode(BTREE_LEAF_NODE, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize, superblock.info.format);
+	KEY_T k;
+
+	// if its the edge case that the leaf node is really a root
+	if(rootLeaf){
+		SIZE_T NewRoot;
+		SIZE_T NewLeaf;
+		
+		// make a new leaf and root node
+		rc = AllocateNode(NewRoot);
+		if(rc){return rc;}
+		rc = AllocateNode(NewLeaf);
 		if(rc){return rc;}
 		
-		// write the data back to the disk
-		return b.Serialize(buffercache, L);
-	}else{
-		// the node we want to insert into is full 
-	//	cout << "**The leaf is full" << endl;
-
-		// read the data from the node
-		rc = b.Unserialize(buffercache, L);
-		if (rc){return rc;}
-	//	cout << "**Node type is "<<b.info.nodetype << endl;
-		switch(b.info.nodetype)
-		{
-	//		cout << "**In nodetype switch"<<endl;
-			// if its the edge case that the leaf node is really a root
-			case BTREE_ROOT_NODE:
-			{
-
-	//			cout << "**In root case"<<endl;
+		// split our full node with our new leaf node
+		// insert our key and value in the appropriate leaf
+		rc = InsertAndSplitLeaf(b,newLeaf,saveOffset,key,val);
+		if(rc){return rc;}
+		// the separator between the two leaves
+		rc = SplitSeparator(b,newLeaf,k);
+		if(rc){return rc;}
+		rc = b.Serialize(buffercache, L);
+		if(rc){return rc;}
+		rc = newLeaf.Serialize(buffercache, NewLeaf);
+		if(rc){return rc;}
+	
+		BTreeNode bNewRoot = BTreeNode(BTREE_ROOT_NODE, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize, superblock.info.format);
 		
-				if(isRootLeaf(b)){
-
-	//				cout << "**Is root leaf"<<endl;
-					
-					SIZE_T NewRoot;
-					SIZE_T NewLeaf;
-					
-					// make a new leaf and root node
-					rc = AllocateNode(NewRoot);
-					rc = AllocateNode(NewLeaf);
-					
-					BTreeNode newRoot = BTreeNode(BTREE_ROOT_NODE, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize);
-					BTreeNode newLeaf = BTreeNode(BTREE_LEAF_NODE, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize);
-					
-					newRoot.Serialize(buffercache, NewRoot);
-					newLeaf.Serialize(buffercache,NewLeaf);
-					
-					b.info.nodetype = BTREE_LEAF_NODE;
-					b.Serialize(buffercache, L);
-					
-	//				cout << "**About to go into InsertAndSplitLeaf from InsertInternal" << endl;
-					// split our full node with our new leaf node
-					// insert our key and value in the appropriate leaf
-					rc = InsertAndSplitLeaf(L,NewLeaf,key,val);
-					if(rc){return rc;}
-					newLeaf.Unserialize(buffercache, NewLeaf);
-					// get the last key in our formerly full node
-					KEY_T k;
-				        rc = newLeaf.GetKey(0,k);
-				        newLeaf.Serialize(buffercache, NewLeaf);
-                               	        if(rc){return rc;}
-				
-					// read data from the new root node
-					BTreeNode bNewRoot;
-					rc = bNewRoot.Unserialize(buffercache, NewRoot);
-					if(rc){return rc;}
-					
-					bNewRoot.info.numkeys++;
-					// set the key of the root node to be a last key of the formerly
-					// full node
-					bNewRoot.SetKey(0,k);
-					// point to the formerly full leaf node
-					bNewRoot.SetPtr(0, L);
-					// point to the new leaf node
-					bNewRoot.SetPtr(1, NewLeaf);
-					
-					
-                                        
-					// write the root back to disk
-					rc = bNewRoot.Serialize(buffercache, NewRoot);
-					
-					// update the superblock to let it know 
-					superblock.info.rootnode = NewRoot;
-					superblock.Serialize(buffercache, superblock_index);
-					
-				}
-				break;
-			}
-			default:
-			{
-				// otherwise we must be looking at a leaf node
-				SIZE_T L2;
-				// allocate space for a new leaf node
-				rc = AllocateNode(L2);
-				// constructs the newLeaf
-				BTreeNode newLeaf = BTreeNode(BTREE_LEAF_NODE, superblock.info.keysize, superblock.info.valuesize, superblock.info.blocksize);
-				newLeaf.Serialize(buffercache, L2);
-				
-				// split the leaf and put half of keys into new leaf node
-				rc = InsertAndSplitLeaf(L,L2,key,val);
-				// go up the tree to its interior nodes and reshuffle things around
-				KEY_T k;
-				newLeaf.Unserialize(buffercache, L2);
-
-				rc = newLeaf.GetKey(0,k);
-				newLeaf.Serialize(buffercache,L2);
-				if(rc){return rc;}
-				rc = InsertRecur(Path,k,L2);
-				break;	
-			}
-		}
+		bNewRoot.info.numkeys++;
+		// set the key of the root node to be the separator
+		bNewRoot.SetKey(0,k);
+		// point to the formerly full leaf node
+		bNewRoot.SetPtr(0, L);
+		// point to the new leaf node
+		bNewRoot.SetPtr(1, NewLeaf);
+		
+		// write the root back to disk
+		rc = bNewRoot.Serialize(buffercache, NewRoot);
+		if(rc){return rc;}
+		
+		// update the superblock to let it know 
+		superblock.info.rootnode = NewRoot;
+		return superblock.Serialize(buffercache, superblock_index);
 	}
 
-	return ERROR_NOERROR;
+	// otherwise we must be looking at a leaf node
+	SIZE_T L2;
+	// allocate space for a new leaf node
+	rc = AllocateNode(L2);
+	if(rc){return rc;}
+	
+	// split the leaf and put half of keys into new leaf node
+	rc = InsertAndSplitLeaf(b,newLeaf,saveOffset,key,val);
+	if(rc){return rc;}
+	rc = SplitSeparator(b,newLeaf,k);
+	if(rc){return rc;}
+	rc = b.Serialize(buffercache, L);
+	if(rc){return rc;}
+	rc = newLeaf.Serialize(buffercache, L2);
+	if(rc){return rc;}
+
+	// go up the tree to its interior nodes and reshuffle things around
+	return InsertIntoParents(Path,k,L2);
 
 }
 
 
-bool BTreeIndex::isRootLeaf(BTreeNode b){
-	return b.info.nodetype == BTREE_ROOT_NODE  && superblock.info.freelist == 2;
+bool BTreeIndex::isRootLeaf(const BTreeNode &b){
+	return b.info.nodetype == BTREE_ROOT_NODE  && RootIsLeaf();
 }
 
-static ERROR_T PrintNode(ostream &os, SIZE_T nodenum, BTreeNode &b, BTreeDisplayType dt)
+// Keys are shown unpacked if the index has a codec
+static ERROR_T PrintNode(ostream &os, SIZE_T nodenum, BTreeNode &b, BTreeDisplayType dt,
+			 const KeyCodec *codec, BufferCache *cache)
 {
   KEY_T key;
   VALUE_T value;
@@ -998,7 +1127,11 @@ static ERROR_T PrintNode(ostream &os, SIZE_T nodenum, BTreeNode &b, BTreeDisplay
 	if (offset==b.info.numkeys) break;
 	rc=b.GetKey(offset,key);
 	if (rc) {  return rc; }
-	for (i=0;i<b.info.keysize;i++) { 
+	if (codec) { 
+	  KEY_T packed(key);
+	  codec->Unpack((const char*)packed.data,packed.length,key);
+	}
+	for (i=0;i<key.length;i++) { 
 	  os << key.data[i];
 	}
 	os << " ";
@@ -1024,7 +1157,11 @@ static ERROR_T PrintNode(ostream &os, SIZE_T nodenum, BTreeNode &b, BTreeDisplay
       }
       rc=b.GetKey(offset,key);
       if (rc) {  return rc; }
-      for (i=0;i<b.info.keysize;i++) { 
+      if (codec) { 
+	KEY_T packed(key);
+	codec->Unpack((const char*)packed.data,packed.length,key);
+      }
+      for (i=0;i<key.length;i++) { 
 	os << key.data[i];
       }
       if (dt==BTREE_SORTED_KEYVAL) { 
@@ -1032,9 +1169,14 @@ static ERROR_T PrintNode(ostream &os, SIZE_T nodenum, BTreeNode &b, BTreeDisplay
       } else {
 	os << " ";
       }
-      rc=b.GetVal(offset,value);
+      SIZE_T chain, length;
+      if (b.GetOverflow(offset,chain,length)==ERROR_NOERROR) { 
+	rc=ReadOverflow(cache,chain,length,value);
+      } else {
+	rc=b.GetVal(offset,value);
+      }
       if (rc) {  return rc; }
-      for (i=0;i<b.info.valuesize;i++) { 
+      for (i=0;i<value.length;i++) { 
 	os << value.data[i];
       }
       if (dt==BTREE_SORTED_KEYVAL) { 
@@ -1057,28 +1199,72 @@ static ERROR_T PrintNode(ostream &os, SIZE_T nodenum, BTreeNode &b, BTreeDisplay
   return ERROR_NOERROR;
 }
   
+// The key the nodes hold for key: key itself, or, if the index has a
+// codec, key packed into packed
+const KEY_T * BTreeIndex::PackKey(const KEY_T &key, KEY_T &packed, ERROR_T &rc) const
+{
+  rc=ERROR_NOERROR;
+  if (keycodec==0) { 
+    return &key;
+  }
+  rc=keycodec->Pack(key,packed);
+  return &packed;
+}
+
 ERROR_T BTreeIndex::Lookup(const KEY_T &key, VALUE_T &value)
 {
-  return LookupOrUpdateInternal(superblock.info.rootnode, BTREE_OP_LOOKUP, key, value);
+  KEY_T packed;
+  ERROR_T rc;
+  const KEY_T *k=PackKey(key,packed,rc);
+  if (rc) { 
+    // no key that can't be packed is in the index
+    return rc==ERROR_SIZE ? ERROR_NONEXISTENT : rc;
+  }
+  return LookupOrUpdateInternal(superblock.info.rootnode, BTREE_OP_LOOKUP, *k, value);
+}
+
+// Whether key and value are the right size for an index: its sizes, 
+// or, for a SLOTTED index, no bigger than them.  key is as the index's
+// users see it, before it's packed.
+static bool RightSize(const NodeMetadata &info, const KEY_T &key, const VALUE_T &value)
+{
+  SIZE_T keysize = info.keycodec.codec!=KEYCODEC_NONE ? info.keycodec.keysize : info.keysize;
+  if (info.format==BTREE_FORMAT_SLOTTED) { 
+    return key.length<=keysize && value.length<=info.valuesize;
+  }
+  return key.length==keysize && value.length==info.valuesize;
 }
 
 ERROR_T BTreeIndex::Insert(const KEY_T &key, const VALUE_T &value)
 {
-  VALUE_T val;
-  if(Lookup(key, val) == ERROR_NOERROR)
+  KEY_T packed;
+  ERROR_T rc;
+  if(!RightSize(superblock.info, key, value))
   {
-  	// we found a duplicate
-  	return ERROR_CONFLICT;
+  	return ERROR_SIZE;
   }
-  // no duplicate
- // cout << "Root node" << superblock.info.rootnode;
-  return InsertInternal(superblock.info.rootnode, key, (VALUE_T&) value);	
+  const KEY_T *k=PackKey(key,packed,rc);
+  if (rc) { 
+  	return rc;
+  }
+  // a duplicate is found at the leaf, on the way down
+  return InsertInternal(superblock.info.rootnode, *k, (VALUE_T&) value);	
   
 }
   
 ERROR_T BTreeIndex::Update(const KEY_T &key, const VALUE_T &value)
 {
-  return LookupOrUpdateInternal(superblock.info.rootnode, BTREE_OP_UPDATE, key, (VALUE_T&) value);
+  KEY_T packed;
+  ERROR_T rc;
+  if(!RightSize(superblock.info, key, value))
+  {
+  	return ERROR_SIZE;
+  }
+  const KEY_T *k=PackKey(key,packed,rc);
+  if (rc) { 
+  	return rc==ERROR_SIZE ? ERROR_NONEXISTENT : rc;
+  }
+  return LookupOrUpdateInternal(superblock.info.rootnode, BTREE_OP_UPDATE, *k, (VALUE_T&) value);
 }
 
   
@@ -1101,58 +1287,74 @@ ERROR_T BTreeIndex::DisplayInternal(const SIZE_T &node,
 				    ostream &o,
 				    BTreeDisplayType display_type) const
 {
-  KEY_T testkey;
-  SIZE_T ptr;
-  BTreeNode b;
+  // Depth first, with the nodes from the root down to the one being
+  // shown on the path, each with the next of its pointers to follow
+  BTreePath path;
+  SIZE_T ptr=node;
+  bool down=true;
   ERROR_T rc;
-  SIZE_T offset;
 
-  rc= b.Unserialize(buffercache,node);
+  while (true) { 
+    if (down) { 
+      // show ptr, and then its children
+      if (path.height==BTREE_MAX_HEIGHT) { 
+	return ERROR_INSANE;
+      }
+      BTreePathNode &level=path.level[path.height++];
+      BTreeNode &b=level.node;
+      level.block=ptr;
+      level.slot=0;
 
-  if (rc!=ERROR_NOERROR) { 
-    return rc;
-  }
+      rc= b.Unserialize(buffercache,ptr);
 
-  rc = PrintNode(o,node,b,display_type);
+      if (rc!=ERROR_NOERROR) { 
+	return rc;
+      }
+
+      rc = PrintNode(o,ptr,b,display_type,keycodec,buffercache);
   
-  if (rc) { return rc; }
+      if (rc) { return rc; }
 
-  if (display_type==BTREE_DEPTH_DOT) { 
-    o << ";";
-  }
+      if (display_type==BTREE_DEPTH_DOT) { 
+	o << ";";
+      }
 
-  if (display_type!=BTREE_SORTED_KEYVAL) {
-    o << endl;
-  }
-  
-  switch (b.info.nodetype) { 
-  case BTREE_ROOT_NODE:
-  case BTREE_INTERIOR_NODE:
-    if (b.info.numkeys>0) { 
-      for (offset=0;offset<=b.info.numkeys;offset++) { 
-      	if(superblock.info.freelist == 2){
-  		continue;
-  	}
-	rc=b.GetPtr(offset,ptr);
-	if (rc) { return rc; }
+      if (display_type!=BTREE_SORTED_KEYVAL) {
+	o << endl;
+      }
+
+      switch (b.info.nodetype) { 
+      case BTREE_ROOT_NODE:
+      case BTREE_INTERIOR_NODE:
+      case BTREE_LEAF_NODE:
+	break;
+      default:
 	if (display_type==BTREE_DEPTH_DOT) { 
-	  o << node << " -> "<<ptr<<";\n";
+	} else {
+	  o << "Unsupported Node Type " << b.info.nodetype ;
 	}
-	rc=DisplayInternal(ptr,o,display_type);
-	if (rc) { return rc; }
+	return ERROR_INSANE;
       }
     }
-    return ERROR_NOERROR;
-    break;
-  case BTREE_LEAF_NODE:
-    return ERROR_NOERROR;
-    break;
-  default:
-    if (display_type==BTREE_DEPTH_DOT) { 
+
+    BTreePathNode &level=path.level[path.height-1];
+    BTreeNode &b=level.node;
+
+    if ((b.info.nodetype==BTREE_ROOT_NODE || b.info.nodetype==BTREE_INTERIOR_NODE) &&
+	!RootIsLeaf() && b.info.numkeys>0 && level.slot<=b.info.numkeys) { 
+      rc=b.GetPtr(level.slot++,ptr);
+      if (rc) { return rc; }
+      if (display_type==BTREE_DEPTH_DOT) { 
+	o << level.block << " -> "<<ptr<<";\n";
+      }
+      down=true;
     } else {
-      o << "Unsupported Node Type " << b.info.nodetype ;
+      // done with this node, and back up to its parent
+      down=false;
+      if (--path.height==0) { 
+	return ERROR_NOERROR;
+      }
     }
-    return ERROR_INSANE;
   }
 
   return ERROR_NOERROR;
@@ -1195,8 +1397,6 @@ ERROR_T BTreeIndex::SanityCheckHelper(set<SIZE_T> &checkedNodes, SIZE_T &node) c
 	SIZE_T ptr;
 	SIZE_T offset;
 	ERROR_T rc;
-	KEY_T testKey;
-	KEY_T tempKey;
 
 
 	// check to see if the node has already been checked
@@ -1234,23 +1434,11 @@ ERROR_T BTreeIndex::SanityCheckHelper(set<SIZE_T> &checkedNodes, SIZE_T &node) c
 			// traverse to node's keys
 			for (offset=0;offset<b.info.numkeys;offset++)
 			{
-				// get the key
-				rc = b.GetKey(offset,testKey);
-				if(rc)
-				{
-					return rc;
-				}
-
-				// get the next key
-				if(offset+1<b.info.numkeys)
+				// check to make sure the keys are sorted,
+				// comparing them in place
+				if(offset+1<b.info.numkeys && b.CompareKeys(offset, offset+1, keyorder) > 0)
 				{
-					rc = b.GetKey(offset+1, tempKey);
-					if(rc){return rc;}
-					// check to make sure the keys are sorted
-					if(tempKey < testKey)
-					{
-						return ERROR_BADORDER;
-					}
+					return ERROR_BADORDER;
 				}
 				// get the ptr to the next level
 				rc = b.GetPtr(offset,ptr);
@@ -1294,21 +1482,11 @@ ERROR_T BTreeIndex::SanityCheckHelper(set<SIZE_T> &checkedNodes, SIZE_T &node) c
 					// go through keys
 					for(offset = 0; offset < b.info.numkeys; offset++)
 					{
-						rc = b.GetKey(offset,testKey);
-						if (rc)
-						{
-							return rc;
-						}
 						// check for order
-						if(offset+1 < b.info.numkeys)
+						if(offset+1 < b.info.numkeys && b.CompareKeys(offset, offset+1, keyorder) > 0)
 						{
-							rc = b.GetKey(offset+1, tempKey);
-							if (rc) {return rc;}
-							if (tempKey < testKey)
-							{
-								return ERROR_BADORDER;
-							}
-						}	
+							return ERROR_BADORDER;
+						}
 					}						
 				}
 			}
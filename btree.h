@@ -3,7 +3,6 @@
 
 #include <iostream>
 #include <string>
-#include <list>
 #include <set>
 
 #include "global.h"
@@ -43,35 +42,84 @@ enum BTreeOp {BTREE_OP_INSERT, BTREE_OP_DELETE, BTREE_OP_UPDATE,BTREE_OP_LOOKUP}
 
 enum BTreeDisplayType {BTREE_DEPTH, BTREE_DEPTH_DOT, BTREE_SORTED_KEYVAL};
 
+// The most levels a descent goes through.  Even two keys a node, a
+// tree this tall would take more blocks than any disk has, so a
+// deeper one is insane (a loop).
+#define BTREE_MAX_HEIGHT 64
+
+// A node on a descent: its block, the node as it was read, so that an
+// insert and any splits change it without reading it again, and the
+// slot of the pointer followed out of it, so that a split child's
+// new sibling goes in right after it without searching the node again
+struct BTreePathNode {
+  SIZE_T    block;
+  SIZE_T    slot;
+  BTreeNode node;
+};
+
+// The nodes of a descent, from the root down, held on the stack
+struct BTreePath {
+  SIZE_T        height;
+  BTreePathNode level[BTREE_MAX_HEIGHT];
+
+  BTreePath() : height(0) {}
+};
+
 class BTreeIndex {
  private:
   BufferCache *buffercache;
   SIZE_T       superblock_index;
   BTreeNode    superblock;
+  // node search for superblock.info.keysize, chosen at Attach
+  KeySearchKernel keysearch;
+  // how interpolation searches of the index's nodes have gone, and
+  // so whether descents search by interpolation (see keysearch.h)
+  mutable KeySearchStats searchstats;
+  // the superblock's key order, or 0 if it's binary (see keyorder.h)
+  const KeyOrder *keyorder;
+  // the superblock's key codec, or 0 if it has none (see keycodec.h)
+  const KeyCodec *keycodec;
+  // node code specialized for the index's node shape, if there is
+  // any (see btree_nodet.h), also chosen at Attach
+  const NodeShape *shape;
 
  protected:
 
   ERROR_T      AllocateNode(SIZE_T &node);
 
   ERROR_T      DeallocateNode(const SIZE_T &node);
+
+  bool         HaveFreeNodes(const SIZE_T num) const;
+
+  bool         RootIsLeaf() const;
+
+  // Values kept out of line, in chains of overflow blocks
+  bool         Overflows(const VALUE_T &value) const;
+  SIZE_T       OverflowBlocks(const VALUE_T &value) const;
+  ERROR_T      WriteOverflow(const VALUE_T &value, SIZE_T &first);
+  ERROR_T      FreeOverflow(SIZE_T block);
+  ERROR_T      SetLeafVal(BTreeNode &leaf, const SIZE_T offset, const VALUE_T &val);
+  ERROR_T      SetLeafKeyVal(BTreeNode &leaf, const SIZE_T offset, const KeyValuePair &kv);
   
-  bool 	       isFull(const SIZE_T &Node) const;
- 
-  bool		isRootLeaf(BTreeNode b);
+  bool		isRootLeaf(const BTreeNode &b);
+
+  const KEY_T *PackKey(const KEY_T &key, KEY_T &packed, ERROR_T &rc) const;
  
-  ERROR_T      InsertFindNode(const SIZE_T &Node, const KEY_T &key, const VALUE_T &value, list<SIZE_T> &Path) const;
+  ERROR_T      InsertFindNode(const SIZE_T &Node, const KEY_T &key, BTreePath &Path) const;
   
-  ERROR_T      InsertAndSplitLeaf(SIZE_T &L1, SIZE_T &L2, const KEY_T &k, const VALUE_T &v);
+  ERROR_T      InsertAndSplitLeaf(BTreeNode &original, BTreeNode &newLeaf, const SIZE_T &at, const KEY_T &k, const VALUE_T &v);
+
+  ERROR_T      SplitSeparator(const BTreeNode &left, const BTreeNode &right, KEY_T &sep) const;
   
-  ERROR_T      InsertAndSplitInterior(SIZE_T &I1, SIZE_T &I2, const KEY_T &k, const SIZE_T &ptr,  KEY_T &newK);
+  ERROR_T      InsertAndSplitInterior(BTreeNode &original, BTreeNode &newInterior, const SIZE_T &at, const KEY_T &k, const SIZE_T &ptr,  KEY_T &newK);
   
-  ERROR_T      InsertAndSplitRoot(SIZE_T &p, SIZE_T &NewInterior, SIZE_T &NewRoot, const KEY_T &k, const SIZE_T &ptr);
+  ERROR_T      InsertAndSplitRoot(BTreeNode &root, const SIZE_T &p, const SIZE_T &at, const SIZE_T &NewInterior, const SIZE_T &NewRoot, const KEY_T &k, const SIZE_T &ptr);
   
-  ERROR_T      InsertRecur(list<SIZE_T> &path, const KEY_T &k, const SIZE_T &ptr);
+  ERROR_T      InsertIntoParents(BTreePath &path, const KEY_T &k, const SIZE_T &ptr);
   
-  ERROR_T      FindAndInsertKeyVal(SIZE_T &Node, const KEY_T &key, const VALUE_T &val);
+  ERROR_T      InsertKeyVal(BTreeNode &b, const SIZE_T &offset, const KEY_T &key, const VALUE_T &val);
   
-  ERROR_T      FindAndInsertKeyPtr(SIZE_T &Node, const KEY_T &key, const SIZE_T &ptr);
+  ERROR_T      InsertKeyPtr(BTreeNode &b, const SIZE_T &offset, const KEY_T &key, const SIZE_T &ptr);
   
   ERROR_T      LookupOrUpdateInternal(const SIZE_T &Node,
 				      const BTreeOp op, 
@@ -98,10 +146,20 @@ public:
   // otherwise, the expectation is that keysize and valuesize
   // will be zero and will be read when Attach(initialblock,false) is 
   // invoked
+  //
+  // format is the node format (see btree_ds.h) a new index is created
+  // with.  In a BTREE_FORMAT_SLOTTED index, keysize and valuesize are
+  // the largest key and value it takes, rather than the size of all
+  // of them.  order is how a new index orders its keys (see 
+  // keyorder.h), binary unless asked for another.  codec is how a new
+  // index packs its keys (see keycodec.h), if it does.
   BTreeIndex(SIZE_T keysize, 
 	     SIZE_T valuesize,
 	     BufferCache *cache,
-	     bool unique=true);   // true if a  key maps to a single value
+	     bool unique=true,    // true if a  key maps to a single value
+	     int format=BTREE_FORMAT_CURRENT,
+	     const KeyOrder &order=KeyOrder(),
+	     const KeyCodec &codec=KeyCodec());
 
 
   BTreeIndex();
@@ -111,7 +169,11 @@ public:
   
 
   // This is called before any inserts, updates, or deletes happen
-  // If create=true, then initblock is meaningless
+  // If create=true, then initblock is meaningless, and 
+  // ERROR_SIZE means the format can't hold keys and values that big,
+  // or the key order's columns don't fit in keysize
+  // ERROR_BADCONFIG means a key codec or BTREE_FORMAT_FOR was asked
+  // for with an order other than binary
   // If create=false, than the index already exists and we are telling you
   // the block that the last detach returned
   // This should be your superblock, which contains the information 
@@ -119,15 +181,25 @@ public:
   // return zero on success or ERROR_NOTANINDEX if we are
   // giving you an incorrect block to start with
   ERROR_T Attach(const SIZE_T initblock, const bool create=false );
+
+  // Whether Attach can create the index as it was constructed:
+  // ERROR_BADCONFIG or ERROR_SIZE if it can't, with why, if given,
+  // set to the reason
+  ERROR_T CheckCreate(const char **why=0) const;
   
   // This is called after all inserts, updates, or deletes are done.
   // We expect you to tell us the number of your superblock, which
   // we will return to you on the next attach
   ERROR_T Detach(SIZE_T &initblock);
+
+  // Grow the disk by at least newblocks blocks and add the new
+  // blocks to the free space, in time proportional to the growth
+  ERROR_T Grow(const SIZE_T newblocks);
   
   // return zero on success
   // return ERROR_NOSPACE if you run out of disk space
   // return ERROR_SIZE if the key or value are the wrong size for this index
+  // (or the key has characters the index's key codec can't pack)
   // return ERROR_CONFLICT if the key already exists and it's a unique index
   ERROR_T Insert(const KEY_T &key, const VALUE_T &value);
   
@@ -2,29 +2,273 @@
 #include <iostream>
 #include <assert.h>
 #include <string.h>
+#include <strings.h>
+#include <stdint.h>
 
 #include "btree_ds.h"
+#include "btree_nodet.h"
+#include "deltapack.h"
 #include "buffercache.h"
 
 #include "btree.h"
 
 using namespace std;
 
+//
+// NARROW header: 28 bytes
+//   u32 nodetype|format<<16, u32 keysize, valuesize, blocksize,
+//   rootnode, freelist, numkeys
+//
+// WIDE (SOA, PREFIX, SLOTTED, FOR) header: 56 bytes
+//   u32 nodetype|format<<16, u32 prefixlen|padlen<<16 (PREFIX), 
+//   heaptop (SLOTTED), deltabits (FOR) or 0, u64 keysize, valuesize,
+//   blocksize, rootnode, freelist, numkeys
+//
+#define NARROW_HEADER_SIZE (7*sizeof(uint32_t))
+#define WIDE_HEADER_SIZE   (2*sizeof(uint32_t)+6*sizeof(uint64_t))
+
+// SLOTTED slots: u16 fields, then the pointer in an interior slot
+#define SLOT_CELL   0
+#define SLOT_KEYLEN 1
+#define SLOT_VALLEN 2
+// set in a leaf slot's value length if the value is out of line
+#define SLOT_OVERFLOW 0x8000
+
+// An out of line value's cell: u64 first block, u64 length
+#define OVERFLOW_REF_SIZE (2*sizeof(uint64_t))
+
+static const char *formatnames[] = { "NARROW", "WIDE", "SOA", "PREFIX", "SLOTTED", "FOR" };
+
+int NodeFormatByName(const char *name)
+{
+  for (int i=0;i<=BTREE_FORMAT_FOR;i++) { 
+    if (!strcasecmp(name,formatnames[i])) { 
+      return i;
+    }
+  }
+  return -1;
+}
+
+SIZE_T NodeMetadata::GetHeaderSize() const
+{
+  return format==BTREE_FORMAT_NARROW ? NARROW_HEADER_SIZE : WIDE_HEADER_SIZE;
+}
+
+SIZE_T NodeMetadata::GetPtrSize() const
+{
+  return format==BTREE_FORMAT_NARROW ? sizeof(uint32_t) : sizeof(uint64_t);
+}
+
 SIZE_T NodeMetadata::GetNumDataBytes() const
 {
-  SIZE_T n=blocksize-sizeof(*this);
+  SIZE_T n=blocksize-GetHeaderSize();
   return n;
 }
 
 
+// Bytes per slot in a SLOTTED node
+static SIZE_T SlotSize(const NodeMetadata &info, const bool leaf)
+{
+  return leaf ? 3*sizeof(uint16_t) : 2*sizeof(uint16_t)+info.GetPtrSize();
+}
+
+SIZE_T NodeMetadata::GetKeyWidth() const
+{
+  return keysize-prefixlen-padlen;
+}
+
+// Slots in a PREFIX node whose keys share prefixlen bytes and end in
+// padlen zeros, capped as described in btree_ds.h
+static SIZE_T PrefixSlots(const NodeMetadata &info, const bool leaf, 
+			  const SIZE_T prefixlen, const SIZE_T padlen)
+{
+  SIZE_T room=info.GetNumDataBytes()-info.GetPtrSize();
+  SIZE_T other=leaf ? info.valuesize : info.GetPtrSize();
+  SIZE_T none=room/(info.keysize+other);
+  SIZE_T cap= none>2 ? 2*none-2 : none;
+  SIZE_T each=info.keysize-prefixlen-padlen+other;
+
+  if (each==0 || (room-prefixlen)/each>cap) { 
+    return cap;
+  } else {
+    return (room-prefixlen)/each;  // floor intended
+  }
+}
+
+// Whether a node's keys are bit packed (see btree_ds.h)
+static bool PackedLeaf(const NodeMetadata &info)
+{
+  return info.format==BTREE_FORMAT_FOR && info.nodetype==BTREE_LEAF_NODE;
+}
+
+// Slots in a FOR leaf whose keys are packed at bits bits, capped as
+// described in btree_ds.h
+static SIZE_T DeltaSlots(const NodeMetadata &info, const SIZE_T bits)
+{
+  SIZE_T room=info.GetNumDataBytes()-info.GetPtrSize()-sizeof(uint64_t);
+  SIZE_T none=room/(info.keysize+info.valuesize);
+  SIZE_T cap= none>2 ? 2*none-2 : none;
+  SIZE_T each=bits+8*info.valuesize;
+
+  if (each==0 || 8*room/each>cap) { 
+    return cap;
+  } else {
+    return 8*room/each;  // floor intended
+  }
+}
+
+// A SLOTTED leaf keeps a value in place if it is no longer than
+// valuesize or an eighth of the node, less a slot and key, whichever
+// is less, but it can always keep a reference to one out of line
+SIZE_T NodeMetadata::GetInlineValueSize() const
+{
+  if (format!=BTREE_FORMAT_SLOTTED) { 
+    return valuesize;
+  }
+  SIZE_T room=GetNumDataBytes()-GetPtrSize();
+  SIZE_T most=room/8>SlotSize(*this,true)+keysize ? room/8-SlotSize(*this,true)-keysize : 0;
+  if (most<OVERFLOW_REF_SIZE) { 
+    most=OVERFLOW_REF_SIZE;
+  }
+  return valuesize<most ? valuesize : most;
+}
+
+// In a SLOTTED node these are the keys it holds at the least, when 
+// they and their values are as long as they can be in place
 SIZE_T NodeMetadata::GetNumSlotsAsInterior() const
 {
-  return (GetNumDataBytes()-sizeof(SIZE_T))/(keysize+sizeof(SIZE_T));  // floor intended
+  if (format==BTREE_FORMAT_PREFIX) { 
+    return PrefixSlots(*this,false,prefixlen,padlen);
+  }
+  if (format==BTREE_FORMAT_SLOTTED) { 
+    return (GetNumDataBytes()-GetPtrSize())/(SlotSize(*this,false)+keysize);  // floor intended
+  }
+  return (GetNumDataBytes()-GetPtrSize())/(keysize+GetPtrSize());  // floor intended
 }
 
 SIZE_T NodeMetadata::GetNumSlotsAsLeaf() const
 {
-  return (GetNumDataBytes()-sizeof(SIZE_T))/(keysize+valuesize);  // floor intended
+  if (format==BTREE_FORMAT_PREFIX) { 
+    return PrefixSlots(*this,true,prefixlen,padlen);
+  }
+  if (format==BTREE_FORMAT_SLOTTED) { 
+    return (GetNumDataBytes()-GetPtrSize())/(SlotSize(*this,true)+keysize+GetInlineValueSize());  // floor intended
+  }
+  if (format==BTREE_FORMAT_FOR) { 
+    return DeltaSlots(*this,deltabits);
+  }
+  return (GetNumDataBytes()-GetPtrSize())/(keysize+valuesize);  // floor intended
+}
+
+bool NodeMetadata::SizesFit() const
+{
+  return SizesProblem()==0;
+}
+
+const char * NodeMetadata::SizesProblem() const
+{
+  if (!keyorder.Fits(keysize)) { 
+    return "the key order's columns don't fit in the key size";
+  }
+  if (GetHeaderSize()+KeyOrder::EncodedSize()+KeyCodec::EncodedSize()>blocksize) { 
+    return "the block size is too small for the superblock";
+  }
+  if (format==BTREE_FORMAT_FOR) { 
+    // a key must be a u64 or less
+    return keysize>0 && keysize<=sizeof(uint64_t) ? 0 : "FOR keys are 1 to 8 bytes";
+  }
+  if (format!=BTREE_FORMAT_SLOTTED) { 
+    return 0;
+  }
+  // cell offsets are u16, and four of the largest cells must fit
+  // (longer values are kept out of line)
+  SIZE_T room=GetNumDataBytes()-GetPtrSize();
+  if (GetNumDataBytes()>0xffff) { 
+    return "SLOTTED blocks are at most 64 KB";
+  }
+  if (4*(SlotSize(*this,true)+keysize+GetInlineValueSize())>room ||
+      4*(SlotSize(*this,false)+keysize)>room) { 
+    return "a SLOTTED node must hold four of the largest keys";
+  }
+  return 0;
+}
+
+
+void NodeMetadata::Encode(char *buf) const
+{
+  uint32_t typeword = (uint32_t)nodetype | ((uint32_t)format<<16);
+
+  if (format==BTREE_FORMAT_NARROW) { 
+    uint32_t h[7] = { typeword, (uint32_t)keysize, (uint32_t)valuesize, (uint32_t)blocksize,
+		      (uint32_t)rootnode, (uint32_t)freelist, (uint32_t)numkeys };
+    memcpy(buf,h,sizeof(h));
+  } else {
+    uint32_t w[2] = { typeword, 
+		      format==BTREE_FORMAT_PREFIX ? (uint32_t)(prefixlen | padlen<<16) : 
+		      format==BTREE_FORMAT_SLOTTED ? (uint32_t)heaptop : 
+		      format==BTREE_FORMAT_FOR ? (uint32_t)deltabits : 0 };
+    uint64_t h[6] = { keysize, valuesize, blocksize, rootnode, freelist, numkeys };
+    memcpy(buf,w,sizeof(w));
+    memcpy(buf+sizeof(w),h,sizeof(h));
+  }
+  if (nodetype==BTREE_SUPERBLOCK) { 
+    keyorder.Encode(buf+GetHeaderSize());
+    keycodec.Encode(buf+GetHeaderSize()+KeyOrder::EncodedSize());
+  }
+}
+
+ERROR_T NodeMetadata::Decode(const char *buf)
+{
+  uint32_t typeword;
+
+  memcpy(&typeword,buf,sizeof(typeword));
+
+  nodetype = typeword & 0xffff;
+  format = typeword >> 16;
+
+  switch (format) { 
+  case BTREE_FORMAT_NARROW: {
+    uint32_t h[7];
+    memcpy(h,buf,sizeof(h));
+    keysize=h[1]; valuesize=h[2]; blocksize=h[3];
+    rootnode=h[4]; freelist=h[5]; numkeys=h[6];
+    prefixlen=0;
+    padlen=0;
+    heaptop=0;
+    deltabits=0;
+    break;
+  }
+  case BTREE_FORMAT_WIDE: 
+  case BTREE_FORMAT_SOA: 
+  case BTREE_FORMAT_PREFIX: 
+  case BTREE_FORMAT_SLOTTED: 
+  case BTREE_FORMAT_FOR: {
+    uint32_t w[2];
+    uint64_t h[6];
+    memcpy(w,buf,sizeof(w));
+    memcpy(h,buf+sizeof(w),sizeof(h));
+    keysize=h[0]; valuesize=h[1]; blocksize=h[2];
+    rootnode=h[3]; freelist=h[4]; numkeys=h[5];
+    prefixlen= format==BTREE_FORMAT_PREFIX ? (w[1] & 0xffff) : 0;
+    padlen= format==BTREE_FORMAT_PREFIX ? (w[1]>>16) : 0;
+    heaptop= format==BTREE_FORMAT_SLOTTED ? w[1] : 0;
+    deltabits= format==BTREE_FORMAT_FOR ? w[1] : 0;
+    if (prefixlen+padlen>keysize || heaptop>GetNumDataBytes() || deltabits>8*sizeof(uint64_t)) { 
+      return ERROR_INSANE;
+    }
+    break;
+  }
+  default:
+    return ERROR_INSANE;
+  }
+
+  keyorder=KeyOrder();
+  keycodec=KeyCodec();
+  if (nodetype==BTREE_SUPERBLOCK) { 
+    ERROR_T rc=keyorder.Decode(buf+GetHeaderSize());
+    return rc ? rc : keycodec.Decode(buf+GetHeaderSize()+KeyOrder::EncodedSize());
+  }
+  return ERROR_NOERROR;
 }
 
 
@@ -34,15 +278,38 @@ ostream & NodeMetadata::Print(ostream &os) const
 				   nodetype==BTREE_SUPERBLOCK ? "SUPERBLOCK" :
 				   nodetype==BTREE_ROOT_NODE ? "ROOT_NODE" :
 				   nodetype==BTREE_INTERIOR_NODE ? "INTERIOR_NODE" :
-				   nodetype==BTREE_LEAF_NODE ? "LEAF_NODE" : "UNKNOWN_TYPE")
+				   nodetype==BTREE_LEAF_NODE ? "LEAF_NODE" :
+				   nodetype==BTREE_OVERFLOW_BLOCK ? "OVERFLOW_BLOCK" : "UNKNOWN_TYPE")
+     << ", format="<<(format>=0 && format<=BTREE_FORMAT_FOR ? formatnames[format] : "UNKNOWN_FORMAT")
      << ", keysize="<<keysize<<", valuesize="<<valuesize<<", blocksize="<<blocksize
-     << ", rootnode="<<rootnode<<", freelist="<<freelist<<", numkeys="<<numkeys<<")";
+     << ", rootnode="<<rootnode<<", freelist="<<freelist<<", numkeys="<<numkeys;
+  if (format==BTREE_FORMAT_PREFIX) { 
+    os << ", prefixlen="<<prefixlen<<", padlen="<<padlen;
+  }
+  if (format==BTREE_FORMAT_SLOTTED) { 
+    os << ", heaptop="<<heaptop;
+  }
+  if (format==BTREE_FORMAT_FOR) { 
+    os << ", deltabits="<<deltabits;
+  }
+  if (nodetype==BTREE_SUPERBLOCK && keyorder.order!=KEYORDER_BINARY) { 
+    os << ", keyorder="<<keyorder;
+  }
+  if (nodetype==BTREE_SUPERBLOCK && keycodec.codec!=KEYCODEC_NONE) { 
+    os << ", keycodec="<<keycodec<<", unpacked keysize="<<keycodec.keysize;
+  }
+  os << ")";
   return os;
 }
 
 BTreeNode::BTreeNode() 
 {
   info.nodetype=BTREE_UNALLOCATED_BLOCK;
+  info.format=BTREE_FORMAT_CURRENT;
+  info.prefixlen=0;
+  info.padlen=0;
+  info.heaptop=0;
+  info.deltabits=0;
   data=0;
 }
 
@@ -56,15 +323,21 @@ BTreeNode::~BTreeNode()
 }
 
 
-BTreeNode::BTreeNode(int node_type, SIZE_T key_size, SIZE_T value_size, SIZE_T block_size)
+BTreeNode::BTreeNode(int node_type, SIZE_T key_size, SIZE_T value_size, SIZE_T block_size,
+		     int format)
 {
   info.nodetype=node_type;
+  info.format=format;
   info.keysize=key_size;
   info.valuesize=value_size;
   info.blocksize=block_size;
   info.rootnode=0;
   info.freelist=0;
   info.numkeys=0;				       
+  info.prefixlen=0;
+  info.padlen=0;
+  info.heaptop=info.GetNumDataBytes();
+  info.deltabits=0;
   data=0;
   if (info.nodetype!=BTREE_UNALLOCATED_BLOCK && info.nodetype!=BTREE_SUPERBLOCK) {
     data = new char [info.GetNumDataBytes()];
@@ -75,12 +348,19 @@ BTreeNode::BTreeNode(int node_type, SIZE_T key_size, SIZE_T value_size, SIZE_T b
 BTreeNode::BTreeNode(const BTreeNode &rhs) 
 {
   info.nodetype=rhs.info.nodetype;
+  info.format=rhs.info.format;
   info.keysize=rhs.info.keysize;
   info.valuesize=rhs.info.valuesize;
   info.blocksize=rhs.info.blocksize;
   info.rootnode=rhs.info.rootnode;
   info.freelist=rhs.info.freelist;
   info.numkeys=rhs.info.numkeys;				       
+  info.prefixlen=rhs.info.prefixlen;
+  info.padlen=rhs.info.padlen;
+  info.heaptop=rhs.info.heaptop;
+  info.deltabits=rhs.info.deltabits;
+  info.keyorder=rhs.info.keyorder;
+  info.keycodec=rhs.info.keycodec;
   data=0;
   if (rhs.data) { 
    data=new char [info.GetNumDataBytes()];
@@ -97,17 +377,23 @@ BTreeNode & BTreeNode::operator=(const BTreeNode &rhs)
 
 ERROR_T BTreeNode::Serialize(BufferCache *b, const SIZE_T blocknum) const
 {
-  assert((unsigned)info.blocksize==b->GetBlockSize());
-  Block block(sizeof(info)+info.GetNumDataBytes());
-  memcpy(block.data,&info,sizeof(info));
+  assert(info.blocksize==b->GetBlockSize());
+  Block block(info.blocksize);
+  memset(block.data,0,info.GetHeaderSize());
   if (info.nodetype!=BTREE_UNALLOCATED_BLOCK && info.nodetype!=BTREE_SUPERBLOCK) { 
-	 memcpy(block.data+sizeof(info),data,info.GetNumDataBytes());
+    if (info.format==BTREE_FORMAT_PREFIX) { 
+      return SerializePrefix(b,blocknum,block);
+    }
+    if (PackedLeaf(info)) { 
+      return SerializeDeltas(b,blocknum,block);
+    }
+    memcpy(block.data+info.GetHeaderSize(),data,info.GetNumDataBytes());
   }
+  info.Encode((char*)block.data);
 
   return b->WriteBlock(blocknum,block);
 }
 
-
 ERROR_T  BTreeNode::Unserialize(BufferCache *b, const SIZE_T blocknum)
 {
   Block block;
@@ -120,201 +406,1328 @@ ERROR_T  BTreeNode::Unserialize(BufferCache *b, const SIZE_T blocknum)
     return rc;
   }
 
-  memcpy(&info,block.data,sizeof(info));
+  rc=info.Decode((const char*)block.data);
+
+  if (rc!=ERROR_NOERROR) { 
+    return rc;
+  }
   
   if (data) { 
     delete [] data;
     data=0;
   }
 
-  assert(b->GetBlockSize()==(unsigned)info.blocksize);
+  assert(b->GetBlockSize()==info.blocksize);
 
   if (info.nodetype!=BTREE_UNALLOCATED_BLOCK && info.nodetype!=BTREE_SUPERBLOCK) {
     data = new char [info.GetNumDataBytes()];
-    memcpy(data,block.data+sizeof(info),info.GetNumDataBytes());
+    memcpy(data,block.data+info.GetHeaderSize(),info.GetNumDataBytes());
   }
   
   return ERROR_NOERROR;
 }
 
 
-char * BTreeNode::ResolveKey(const SIZE_T offset) const
+//
+// The node layout, shared by BTreeNode (over its own copy of the
+// data) and BTreeNodeView (over the cache frame).  data is the start
+// of the data area, just past the header.
+//
+static char * LayoutSlot(const NodeMetadata &info, const char *data, const SIZE_T offset)
+{
+  const bool leaf = info.nodetype==BTREE_LEAF_NODE;
+  return (char*)data+info.GetPtrSize()+offset*SlotSize(info,leaf);
+}
+
+static SIZE_T SlotField(const char *slot, const int field)
+{
+  uint16_t f;
+  memcpy(&f,slot+field*sizeof(f),sizeof(f));
+  return f;
+}
+
+static void SetSlotField(char *slot, const int field, const SIZE_T value)
+{
+  uint16_t f=value;
+  memcpy(slot+field*sizeof(f),&f,sizeof(f));
+}
+
+// Bytes of a leaf cell's value, in place (a reference if out of line)
+static SIZE_T SlotValLength(const char *slot)
+{
+  return SlotField(slot,SLOT_VALLEN) & ~SLOT_OVERFLOW;
+}
+
+// A FOR leaf's base, followed by its packed keys
+static uint64_t DeltaBase(const char *data)
+{
+  uint64_t base;
+  memcpy(&base,data,sizeof(base));
+  return base;
+}
+
+static void SetDeltaBase(char *data, const uint64_t base)
+{
+  memcpy(data,&base,sizeof(base));
+}
+
+static char * DeltaKeys(const char *data)
+{
+  return (char*)data+sizeof(uint64_t);
+}
+
+// A key, zero padded to keysize bytes, as a big endian integer, and back
+static uint64_t KeyInteger(const char *key, const SIZE_T keylen, const SIZE_T keysize)
+{
+  uint64_t v=0;
+  for (SIZE_T i=0;i<keysize;i++) { 
+    v=(v<<8) | (i<keylen ? (unsigned char)key[i] : 0);
+  }
+  return v;
+}
+
+static void IntegerKey(uint64_t v, const SIZE_T keysize, char *key)
+{
+  for (SIZE_T i=keysize;i>0;i--) { 
+    key[i-1]=(char)(v & 0xff);
+    v>>=8;
+  }
+}
+
+// The ith key of a FOR leaf, as an integer
+static uint64_t LayoutKeyInteger(const NodeMetadata &info, const char *data, const SIZE_T offset)
+{
+  return DeltaBase(data)+deltapack_get(DeltaKeys(data),info.deltabits,offset);
+}
+
+static char * LayoutKey(const NodeMetadata &info, const char *data, const SIZE_T offset)
 {
+  const bool soa = info.format==BTREE_FORMAT_SOA || info.format==BTREE_FORMAT_FOR;
+
+  if (info.format==BTREE_FORMAT_SLOTTED) { 
+    switch (info.nodetype) { 
+    case BTREE_INTERIOR_NODE:
+    case BTREE_ROOT_NODE:
+    case BTREE_LEAF_NODE:
+      assert(offset<info.numkeys);
+      return (char*)data+SlotField(LayoutSlot(info,data,offset),SLOT_CELL);
+    default:
+      return 0;
+    }
+  }
+
+  if (info.format==BTREE_FORMAT_PREFIX) { 
+    switch (info.nodetype) { 
+    case BTREE_INTERIOR_NODE:
+    case BTREE_ROOT_NODE:
+    case BTREE_LEAF_NODE:
+      assert(offset<info.numkeys);
+      return (char*)data+info.prefixlen+offset*info.GetKeyWidth();
+    default:
+      return 0;
+    }
+  }
+
+  if (PackedLeaf(info)) { 
+    // the keys aren't bytes of their own, see LayoutKeyInteger
+    assert(offset<info.numkeys);
+    return DeltaKeys(data);
+  }
+
   switch (info.nodetype) { 
   case BTREE_INTERIOR_NODE:
   case BTREE_ROOT_NODE:
     assert(offset<info.numkeys);
-    return data+sizeof(SIZE_T)+offset*(sizeof(SIZE_T)+info.keysize);
+    if (soa) { 
+      return (char*)data+offset*info.keysize;
+    }
+    return (char*)data+info.GetPtrSize()+offset*(info.GetPtrSize()+info.keysize);
     break;
   case BTREE_LEAF_NODE:
-    // cout << "offset: " <<offset<<endl;
-    // cout << "numkeys: " << info.numkeys <<endl;
     assert(offset<info.numkeys);
-    return data+sizeof(SIZE_T)+offset*(info.keysize+info.valuesize);
+    if (soa) { 
+      return (char*)data+info.GetPtrSize()+offset*info.keysize;
+    }
+    return (char*)data+info.GetPtrSize()+offset*(info.keysize+info.valuesize);
     break;
   default:
     return 0;
   }
 }
 
-
-char * BTreeNode::ResolvePtr(const SIZE_T offset) const
+static char * LayoutPtr(const NodeMetadata &info, const char *data, const SIZE_T offset)
 {
+  const bool soa = info.format==BTREE_FORMAT_SOA || info.format==BTREE_FORMAT_FOR;
+  const bool prefix = info.format==BTREE_FORMAT_PREFIX;
+
   switch (info.nodetype) { 
   case BTREE_INTERIOR_NODE:
   case BTREE_ROOT_NODE:
     assert(offset<=info.numkeys);
-    return data+offset*(sizeof(SIZE_T)+info.keysize);
+    if (info.format==BTREE_FORMAT_SLOTTED) { 
+      // the pointer after each key is in its slot
+      return offset==0 ? (char*)data : LayoutSlot(info,data,offset-1)+2*sizeof(uint16_t);
+    }
+    if (prefix) { 
+      return (char*)data+info.GetNumDataBytes()-(offset+1)*info.GetPtrSize();
+    }
+    if (soa) { 
+      return (char*)data+info.GetNumSlotsAsInterior()*info.keysize+offset*info.GetPtrSize();
+    }
+    return (char*)data+offset*(info.GetPtrSize()+info.keysize);
     break;
   case BTREE_LEAF_NODE:
     assert(offset==0);
-    return data;
+    if (prefix || info.format==BTREE_FORMAT_FOR) { 
+      return (char*)data+info.GetNumDataBytes()-info.GetPtrSize();
+    }
+    return (char*)data;
     break;
   default:
     return 0;
   }
 }
 
-
-
-char * BTreeNode::ResolveVal(const SIZE_T offset) const
+static char * LayoutVal(const NodeMetadata &info, const char *data, const SIZE_T offset)
 {
-
   switch (info.nodetype) { 
   case BTREE_LEAF_NODE:
     assert(offset<info.numkeys);
-    return data+sizeof(SIZE_T)+offset*(info.keysize+info.valuesize)+info.keysize;
+    if (info.format==BTREE_FORMAT_SLOTTED) { 
+      const char *slot=LayoutSlot(info,data,offset);
+      return (char*)data+SlotField(slot,SLOT_CELL)+SlotField(slot,SLOT_KEYLEN);
+    }
+    if (info.format==BTREE_FORMAT_PREFIX || info.format==BTREE_FORMAT_FOR) { 
+      return (char*)data+info.GetNumDataBytes()-info.GetPtrSize()-(offset+1)*info.valuesize;
+    }
+    if (info.format==BTREE_FORMAT_SOA) { 
+      return (char*)data+info.GetPtrSize()+info.GetNumSlotsAsLeaf()*info.keysize+offset*info.valuesize;
+    }
+    return (char*)data+info.GetPtrSize()+offset*(info.keysize+info.valuesize)+info.keysize;
     break;
   default:
     return 0;
   }
 }
 
-
-
-char * BTreeNode::ResolveKeyVal(const SIZE_T offset) const
+static SIZE_T LayoutKeyLength(const NodeMetadata &info, const char *data, const SIZE_T offset)
 {
-  return ResolveKey(offset);
+  if (info.format==BTREE_FORMAT_SLOTTED) { 
+    assert(offset<info.numkeys);
+    return SlotField(LayoutSlot(info,data,offset),SLOT_KEYLEN);
+  }
+  return info.keysize;
 }
 
-ERROR_T BTreeNode::GetKey(const SIZE_T offset, KEY_T &k) const
+static SIZE_T LayoutValLength(const NodeMetadata &info, const char *data, const SIZE_T offset)
 {
-  char *p=ResolveKey(offset);
-
-  if (p==0) { 
-    return ERROR_NOMEM;
+  if (info.format==BTREE_FORMAT_SLOTTED) { 
+    assert(offset<info.numkeys);
+    return SlotValLength(LayoutSlot(info,data,offset));
   }
-  
-  k.Resize(info.keysize,false);
-  memcpy(k.data,p,info.keysize);
-  return ERROR_NOERROR;
+  return info.valuesize;
 }
 
-ERROR_T BTreeNode::GetPtr(const SIZE_T offset, SIZE_T &ptr) const
+static bool LayoutIsOverflow(const NodeMetadata &info, const char *data, const SIZE_T offset)
 {
-  char *p=ResolvePtr(offset);
-
-  if (p==0) { 
-    return ERROR_NOMEM;
-  }
-  
-  memcpy(&ptr,p,sizeof(SIZE_T));
-  return ERROR_NOERROR;
+  return info.format==BTREE_FORMAT_SLOTTED && info.nodetype==BTREE_LEAF_NODE &&
+    offset<info.numkeys && (SlotField(LayoutSlot(info,data,offset),SLOT_VALLEN) & SLOT_OVERFLOW);
 }
 
-ERROR_T BTreeNode::GetVal(const SIZE_T offset, VALUE_T &v) const
+static ERROR_T LayoutGetOverflow(const NodeMetadata &info, const char *data, const SIZE_T offset,
+				 SIZE_T &block, SIZE_T &length)
 {
-  char *p=ResolveVal(offset);
-
-  if (p==0) { 
-    return ERROR_NOMEM;
+  if (!LayoutIsOverflow(info,data,offset)) { 
+    return ERROR_NONEXISTENT;
   }
-  
-  v.Resize(info.valuesize,false);
-  memcpy(v.data,p,info.valuesize);
+  uint64_t ref[2];
+  memcpy(ref,LayoutVal(info,data,offset),sizeof(ref));
+  block=ref[0];
+  length=ref[1];
   return ERROR_NOERROR;
 }
 
+// Bytes of the ith cell of a SLOTTED node, and of its slot
+static SIZE_T SlottedBytes(const NodeMetadata &info, const char *data, const SIZE_T offset)
+{
+  const bool leaf = info.nodetype==BTREE_LEAF_NODE;
+  const char *slot=LayoutSlot(info,data,offset);
+  return SlotSize(info,leaf)+SlotField(slot,SLOT_KEYLEN)+(leaf ? SlotValLength(slot) : 0);
+}
 
-ERROR_T BTreeNode::GetKeyVal(const SIZE_T offset, KeyValuePair &p) const
+int CompareKeyBytes(const char *a, const SIZE_T alen, const char *b, const SIZE_T blen,
+		    const KeyOrder *order)
 {
-  ERROR_T rc= GetKey(offset,p.key);
+  return order ? order->Compare(a,alen,b,blen) : BinaryOrder().Compare(a,alen,b,blen);
+}
 
-  if (rc!=ERROR_NOERROR) { 
-    return rc; 
+// Compare key (of keylen bytes) with a stored key (or prefix or 
+// suffix) of width bytes.  A shorter key that matches as far as it
+// goes is less.
+static int CompareStored(const char *key, const SIZE_T keylen, const char *stored, const SIZE_T width)
+{
+  if (keylen>=width) { 
+    return memcmp(key,stored,width);
   } else {
-    return GetVal(offset,p.value);
+    int c=memcmp(key,stored,keylen);
+    return c ? c : -1;
   }
 }
 
+static SIZE_T CommonPrefix(const char *a, const char *b, const SIZE_T n)
+{
+  SIZE_T i=0;
+  while (i<n && a[i]==b[i]) { 
+    i++;
+  }
+  return i;
+}
 
-ERROR_T BTreeNode::SetKey(const SIZE_T offset, const KEY_T &k)
+// Compare the rest of a key (of keylen bytes) with padlen zeros
+static int CompareZeros(const char *key, const SIZE_T keylen, const SIZE_T padlen)
 {
-  char *p=ResolveKey(offset);
+  for (SIZE_T i=0;i<keylen && i<padlen;i++) { 
+    if (key[i]) { 
+      return 1;
+    }
+  }
+  return keylen<padlen ? -1 : 0;
+}
 
-  if (p==0) { 
-    return ERROR_NOMEM;
+// Room to put a PREFIX node's key back together, on the stack unless
+// it's long
+struct KeyScratch {
+  char  stack[256];
+  char *buf;
+
+  KeyScratch(const SIZE_T n) : buf(n<=sizeof(stack) ? stack : new char [n]) {}
+  ~KeyScratch() { if (buf!=stack) { delete [] buf; } }
+};
+
+// The whole of the ith key, in place, or put back together in buf 
+// if the node stores only part of it, or unpacks it
+static const char * LayoutWholeKey(const NodeMetadata &info, const char *data,
+				   const SIZE_T offset, char *buf)
+{
+  if (PackedLeaf(info)) { 
+    IntegerKey(LayoutKeyInteger(info,data,offset),info.keysize,buf);
+    return buf;
   }
 
-  memcpy(p,k.data,info.keysize);
+  const char *p=LayoutKey(info,data,offset);
 
-  return ERROR_NOERROR;
+  if (info.prefixlen==0 && info.padlen==0) { 
+    return p;
+  }
+  memcpy(buf,data,info.prefixlen);
+  memcpy(buf+info.prefixlen,p,info.GetKeyWidth());
+  memset(buf+info.prefixlen+info.GetKeyWidth(),0,info.padlen);
+  return buf;
 }
 
-
-ERROR_T BTreeNode::SetPtr(const SIZE_T offset, const SIZE_T &ptr)
+// <0, 0, >0 as key (of keylen bytes) is less than, equal to, or 
+// greater than the ith key.  A key longer than keysize is greater 
+// than a stored key it matches.  In an order other than binary (see
+// keyorder.h) the prefix and padding mean nothing by themselves, so
+// the stored key is compared whole, as is a FOR leaf's unpacked key.
+static int LayoutCompareKey(const NodeMetadata &info, const char *data, 
+			    const SIZE_T offset, const char *key, const SIZE_T keylen,
+			    const KeyOrder *order)
 {
-  char *p=ResolvePtr(offset);
+  const char *p=LayoutKey(info,data,offset);
+  const char *k=key;
+  SIZE_T klen=keylen;
+  int c;
 
-  if (p==0) { 
-    return ERROR_NOMEM;
+  if (info.format==BTREE_FORMAT_SLOTTED) { 
+    return CompareKeyBytes(k,klen,p,LayoutKeyLength(info,data,offset),order);
+  }
+  if (order || PackedLeaf(info)) { 
+    KeyScratch scratch(info.keysize);
+    return CompareKeyBytes(k,klen,LayoutWholeKey(info,data,offset,scratch.buf),info.keysize,order);
   }
+  if (info.prefixlen>0) { 
+    c=CompareStored(k,klen,data,info.prefixlen);
+    if (c) { 
+      return c;
+    }
+    k+=info.prefixlen;
+    klen-=info.prefixlen;
+  }
+  c=CompareStored(k,klen,p,info.GetKeyWidth());
+  if (c==0 && info.padlen>0) { 
+    c=CompareZeros(k+info.GetKeyWidth(),klen-info.GetKeyWidth(),info.padlen);
+  }
+  return c==0 && keylen>info.keysize ? 1 : c;
+}
 
-  memcpy(p,&ptr,sizeof(SIZE_T));
+// <0, 0, >0 as the ith key is less than, equal to, or greater than
+// the jth.  Both have the node's prefix and padding, if any.
+static int LayoutCompareKeys(const NodeMetadata &info, const char *data, 
+			     const SIZE_T i, const SIZE_T j, const KeyOrder *order)
+{
+  const char *a=LayoutKey(info,data,i);
+  const char *b=LayoutKey(info,data,j);
 
-  return ERROR_NOERROR;
+  if (info.format==BTREE_FORMAT_SLOTTED) { 
+    return CompareKeyBytes(a,LayoutKeyLength(info,data,i),b,LayoutKeyLength(info,data,j),order);
+  }
+  if (order) { 
+    KeyScratch sa(info.keysize), sb(info.keysize);
+    return order->Compare(LayoutWholeKey(info,data,i,sa.buf),info.keysize,
+			  LayoutWholeKey(info,data,j,sb.buf),info.keysize);
+  }
+  if (PackedLeaf(info)) { 
+    uint64_t x=LayoutKeyInteger(info,data,i), y=LayoutKeyInteger(info,data,j);
+    return x<y ? -1 : x>y ? 1 : 0;
+  }
+  return memcmp(a,b,info.GetKeyWidth());
 }
 
+// Bytes from one key to the next
+static SIZE_T LayoutKeyStride(const NodeMetadata &info)
+{
+  if (info.format==BTREE_FORMAT_PREFIX) { 
+    return info.GetKeyWidth();
+  } else if (info.format==BTREE_FORMAT_SOA || info.format==BTREE_FORMAT_FOR) { 
+    return info.keysize;
+  } else if (info.nodetype==BTREE_LEAF_NODE) { 
+    return info.keysize+info.valuesize;
+  } else {
+    return info.GetPtrSize()+info.keysize;
+  }
+}
 
-
-ERROR_T BTreeNode::SetVal(const SIZE_T offset, const VALUE_T &v)
+// LayoutSearch in an order other than binary, with the order's
+// comparison inlined into the loop
+template <class Order>
+static SIZE_T LayoutSearchIn(const Order &order, const NodeMetadata &info, const char *data,
+			     const KEY_T &key, const bool strict)
 {
-  char *p=ResolveVal(offset);
-  
-  if (p==0) { 
-    return ERROR_NOMEM;
+  const bool slotted = info.format==BTREE_FORMAT_SLOTTED;
+  KeyScratch scratch(slotted ? 0 : info.keysize);
+  SIZE_T lo=0, hi=info.numkeys;
+
+  while (lo<hi) { 
+    SIZE_T mid=lo+(hi-lo)/2;
+    const char *p=slotted ? LayoutKey(info,data,mid) : LayoutWholeKey(info,data,mid,scratch.buf);
+    int c=order.Compare((const char*)key.data,key.length,p,LayoutKeyLength(info,data,mid));
+    if (c>0 || (strict && c==0)) { 
+      lo=mid+1;
+    } else {
+      hi=mid;
+    }
   }
-  
-  memcpy(p,v.data,info.valuesize);
-  
-  return ERROR_NOERROR;
+  return lo;
 }
 
+// Nodes with fewer keys than this are searched the usual way, even
+// when searches interpolate
+#define INTERPOLATE_MIN 8
 
-ERROR_T BTreeNode::SetKeyVal(const SIZE_T offset, const KeyValuePair &p)
+// The first 8 bytes, zero padded, of the part of a key (of keylen 
+// bytes) that a node stores, as a big endian integer, or a FOR leaf
+// key's integer.  Keys in binary order have them in the same order.
+static uint64_t KeyLead(const NodeMetadata &info, const char *key, const SIZE_T keylen)
 {
-  ERROR_T rc=SetKey(offset,p.key);
+  if (PackedLeaf(info)) { 
+    return KeyInteger(key,keylen,info.keysize);
+  }
+  return KeyInteger(key,keylen<sizeof(uint64_t) ? keylen : sizeof(uint64_t),sizeof(uint64_t));
+}
 
-  if (rc!=ERROR_NOERROR) { 
-    return rc;
-  } else {
-    return SetVal(offset,p.value);
+static uint64_t LayoutKeyLead(const NodeMetadata &info, const char *data, const SIZE_T offset)
+{
+  if (PackedLeaf(info)) { 
+    return LayoutKeyInteger(info,data,offset);
   }
+  SIZE_T len= info.format==BTREE_FORMAT_SLOTTED ? LayoutKeyLength(info,data,offset) : info.GetKeyWidth();
+  return KeyLead(info,LayoutKey(info,data,offset),len);
 }
 
+// LayoutSearch by interpolation: each probe is where key would be if
+// the keys left were spread evenly between the nearest ones probed
+// (the first and last to begin with), by their leading bytes, or the
+// middle, if the last probe didn't halve the keys left.  So a search 
+// never probes more than about twice as many keys as a binary search
+// does.  probes is how many keys it looked at.  A PREFIX node's 
+// prefix must already match key's.
+static SIZE_T LayoutInterpolate(const NodeMetadata &info, const char *data,
+				const KEY_T &key, const bool strict, SIZE_T &probes)
+{
+  const SIZE_T skip= PackedLeaf(info) ? 0 : info.prefixlen;
+  const uint64_t x=KeyLead(info,(const char*)key.data+skip,key.length-skip);
+  SIZE_T lo=0, hi=info.numkeys;
+  uint64_t below=LayoutKeyLead(info,data,0);
+  uint64_t above=LayoutKeyLead(info,data,hi-1);
+  bool halved=true;
+
+  probes=2;
+  while (lo<hi) { 
+    SIZE_T mid;
+    if (!halved || above<=below) { 
+      mid=lo+(hi-lo)/2;
+    } else if (x<=below) { 
+      mid=lo;
+    } else if (x>=above) { 
+      mid=hi-1;
+    } else {
+      mid=lo+(SIZE_T)((unsigned __int128)(x-below)*(hi-lo)/(above-below));
+      mid= mid<hi ? mid : hi-1;
+    }
+    const SIZE_T before=hi-lo;
+    int c=LayoutCompareKey(info,data,mid,(const char*)key.data,key.length,0);
+    probes++;
+    if (c>0 || (strict && c==0)) { 
+      lo=mid+1;
+      below=LayoutKeyLead(info,data,mid);
+    } else {
+      hi=mid;
+      above=LayoutKeyLead(info,data,mid);
+    }
+    halved= 2*(hi-lo)<=before;
+  }
+  return lo;
+}
 
+// Binary search for the first key that is greater than or equal to
+// key, or, if strict, greater than key.  numkeys if there is none.
+// A kernel does the same search with fixed width compares, but only
+// for keys that are exactly keysize long.  In a PREFIX node
+// the search is over the stored part of the keys, with the kernel for
+// its width.  A key with something other than zeros where the stored
+// keys have their padding is greater than any stored key it matches,
+// so it is searched for strictly.  The keys of a SLOTTED node are not
+// a fixed width apart, so it never uses a kernel.  A FOR leaf is 
+// searched for the key's difference from its base, among its packed
+// keys.  Given an order, the search is in it instead (see keyorder.h).
+// Given stats, the search is by interpolation while they say it pays,
+// except in an order other than binary.
+static SIZE_T LayoutSearch(const NodeMetadata &info, const char *data,
+			   const KEY_T &key, bool strict,
+			   KeySearchKernel kernel, const KeyOrder *order,
+			   KeySearchStats *stats)
+{
+  SIZE_T lo=0, hi=info.numkeys;
+
+  if (order) { 
+    switch (order->order) { 
+    case KEYORDER_UNSIGNED:
+      return LayoutSearchIn(UnsignedOrder(),info,data,key,strict);
+    case KEYORDER_SIGNED:
+      return LayoutSearchIn(SignedOrder(),info,data,key,strict);
+    case KEYORDER_NOCASE:
+      return LayoutSearchIn(NoCaseOrder(),info,data,key,strict);
+    case KEYORDER_COMPOSITE:
+      return LayoutSearchIn(CompositeOrder(*order),info,data,key,strict);
+    default:
+      return LayoutSearchIn(BinaryOrder(),info,data,key,strict);
+    }
+  }
 
+  if (info.format==BTREE_FORMAT_SLOTTED || PackedLeaf(info)) { 
+    kernel=0;
+  }
 
-ostream & BTreeNode::Print(ostream &os) const 
-{
-  os << "BTreeNode(info="<<info;
-  if (info.nodetype!=BTREE_UNALLOCATED_BLOCK && info.nodetype!=BTREE_SUPERBLOCK) { 
-    os <<", ";
-    if (info.nodetype==BTREE_INTERIOR_NODE || info.nodetype==BTREE_ROOT_NODE) {
-      SIZE_T ptr;
-      KEY_T key;
-      os << "pointers_and_values=(";
-      if (info.numkeys>0) { // ==0 implies an empty root node
+  if (hi>0 && info.format==BTREE_FORMAT_PREFIX) { 
+    if (info.prefixlen>0) { 
+      int c=CompareStored((const char*)key.data,key.length,data,info.prefixlen);
+      if (c) { 
+	return c<0 ? 0 : hi;
+      }
+    }
+    if (key.length>=info.keysize && info.padlen>0 &&
+	CompareZeros((const char*)key.data+info.keysize-info.padlen,info.padlen,info.padlen)) { 
+      strict=true;
+    }
+    kernel=keysearch_choose(info.GetKeyWidth());
+  }
+
+  if (stats) { 
+    if (stats->interpolate && hi>=INTERPOLATE_MIN) { 
+      SIZE_T probes;
+      SIZE_T at=LayoutInterpolate(info,data,key,strict,probes);
+      stats->Record(hi,probes);
+      return at;
+    }
+    stats->Skip();
+  }
+
+  if (PackedLeaf(info)) { 
+    if (hi>0 && key.length==info.keysize) { 
+      const uint64_t x=KeyInteger((const char*)key.data,key.length,info.keysize);
+      const uint64_t base=DeltaBase(data);
+      if (x<base) { 
+	return 0;
+      }
+      if (x-base>deltapack_mask(info.deltabits)) { 
+	return hi;
+      }
+      return deltapack_search(DeltaKeys(data),info.deltabits,hi,x-base,strict);
+    }
+  }
+
+  if (kernel && hi>0 && key.length==info.keysize) { 
+    return kernel(LayoutKey(info,data,0),LayoutKeyStride(info),hi,
+		  (const char*)key.data+info.prefixlen,strict);
+  }
+
+  while (lo<hi) { 
+    SIZE_T mid=lo+(hi-lo)/2;
+    int c=LayoutCompareKey(info,data,mid,(const char*)key.data,key.length,0);
+    if (c>0 || (strict && c==0)) { 
+      lo=mid+1;
+    } else {
+      hi=mid;
+    }
+  }
+  return lo;
+}
+
+// Zero bytes at the end of the first n bytes of a key, at most max
+static SIZE_T TrailingZeros(const char *key, const SIZE_T n, const SIZE_T max)
+{
+  SIZE_T z=0;
+  while (z<n && z<max && key[n-1-z]==0) { 
+    z++;
+  }
+  return z;
+}
+
+// See BTreeNode::GetNumSlotsWith
+static SIZE_T LayoutSlotsWith(const NodeMetadata &info, const char *data, const KEY_T &key)
+{
+  const bool leaf = info.nodetype==BTREE_LEAF_NODE;
+
+  if (info.format==BTREE_FORMAT_SLOTTED) { 
+    // room for key and the largest value, or a pointer
+    SIZE_T used=info.GetPtrSize();
+    for (SIZE_T i=0;i<info.numkeys;i++) { 
+      used+=SlottedBytes(info,data,i);
+    }
+    SIZE_T need=SlotSize(info,leaf)+key.length+(leaf ? info.GetInlineValueSize() : 0);
+    return used+need<=info.GetNumDataBytes() ? info.numkeys+1 : info.numkeys;
+  }
+
+  if (PackedLeaf(info)) { 
+    // as many as fit with the keys widened to take key in
+    if (info.numkeys==0) { 
+      return DeltaSlots(info,0);
+    }
+    uint64_t x=KeyInteger((const char*)key.data,key.length,info.keysize);
+    uint64_t lo=LayoutKeyInteger(info,data,0);
+    uint64_t hi=LayoutKeyInteger(info,data,info.numkeys-1);
+    lo= x<lo ? x : lo;
+    hi= x>hi ? x : hi;
+    return DeltaSlots(info,deltapack_bits(hi-lo));
+  }
+
+  if (info.format!=BTREE_FORMAT_PREFIX) { 
+    return leaf ? info.GetNumSlotsAsLeaf() : info.GetNumSlotsAsInterior();
+  }
+
+  const char *k=(const char*)key.data;
+  SIZE_T n = key.length<info.keysize ? key.length : info.keysize;
+  SIZE_T q, z;
+
+  if (info.numkeys==0) { 
+    q=n;
+    z=0;
+  } else {
+    q=CommonPrefix(data,k,info.prefixlen<n ? info.prefixlen : n);
+    z= n<info.keysize ? 0 : TrailingZeros(k,n,info.padlen);
+  }
+  if (q+z>info.keysize) { 
+    z=info.keysize-q;
+  }
+  
+  return PrefixSlots(info,leaf,q,z);
+}
+
+// Bytes the pointers or values of n keys take at the end of a PREFIX node
+static SIZE_T PrefixTailBytes(const NodeMetadata &info, const SIZE_T n)
+{
+  if (info.nodetype==BTREE_LEAF_NODE) { 
+    return info.GetPtrSize()+n*info.valuesize;
+  } else {
+    return (n+1)*info.GetPtrSize();
+  }
+}
+
+static ERROR_T LayoutGetKey(const NodeMetadata &info, const char *data, 
+			    const SIZE_T offset, KEY_T &k)
+{
+  const char *p=LayoutKey(info,data,offset);
+
+  if (p==0) { 
+    return ERROR_NOMEM;
+  }
+  
+  if (info.format==BTREE_FORMAT_SLOTTED) { 
+    SIZE_T len=LayoutKeyLength(info,data,offset);
+    k.Resize(len,false);
+    memcpy(k.data,p,len);
+    return ERROR_NOERROR;
+  }
+
+  k.Resize(info.keysize,false);
+  if (PackedLeaf(info)) { 
+    IntegerKey(LayoutKeyInteger(info,data,offset),info.keysize,(char*)k.data);
+    return ERROR_NOERROR;
+  }
+  memcpy(k.data,data,info.prefixlen);
+  memcpy(k.data+info.prefixlen,p,info.GetKeyWidth());
+  memset(k.data+info.prefixlen+info.GetKeyWidth(),0,info.padlen);
+  return ERROR_NOERROR;
+}
+
+static SIZE_T DecodePtr(const NodeMetadata &info, const char *p)
+{
+  if (info.GetPtrSize()==sizeof(uint32_t)) { 
+    uint32_t narrow;
+    memcpy(&narrow,p,sizeof(narrow));
+    return narrow;
+  } else {
+    uint64_t wide;
+    memcpy(&wide,p,sizeof(wide));
+    return wide;
+  }
+}
+
+
+//
+// A PREFIX node is written with the longest prefix its keys share,
+// and the most zeros they all end in, which may be more than it has
+// in memory
+//
+ERROR_T BTreeNode::SerializePrefix(BufferCache *b, const SIZE_T blocknum, Block &block) const
+{
+  NodeMetadata out=info;
+  char *outdata=(char*)block.data+info.GetHeaderSize();
+  const SIZE_T plen=info.prefixlen;
+  const SIZE_T width=info.GetKeyWidth();
+  SIZE_T common=width;
+  SIZE_T zeros=width;
+
+  if (info.numkeys==0) { 
+    out.prefixlen=0;
+    out.padlen=0;
+  } else {
+    const char *first=data+plen;
+    for (SIZE_T i=1;i<info.numkeys && common>0;i++) { 
+      common=CommonPrefix(first,data+plen+i*width,common);
+    }
+    for (SIZE_T i=0;i<info.numkeys && zeros>0;i++) { 
+      zeros=TrailingZeros(data+plen+i*width,width,zeros);
+    }
+    if (common+zeros>width) { 
+      // the keys are all the same, and all zeros after the prefix
+      zeros=width-common;
+    }
+    out.prefixlen=plen+common;
+    out.padlen=info.padlen+zeros;
+  }
+
+  // the pointers or values at the end stay where they are
+  memcpy(outdata,data,info.GetNumDataBytes());
+
+  if (out.prefixlen>plen || out.padlen>info.padlen) { 
+    const SIZE_T outwidth=out.GetKeyWidth();
+    memcpy(outdata+plen,data+plen,common);
+    for (SIZE_T i=0;i<info.numkeys;i++) { 
+      memcpy(outdata+out.prefixlen+i*outwidth,data+plen+i*width+common,outwidth);
+    }
+  }
+
+  out.Encode((char*)block.data);
+
+  return b->WriteBlock(blocknum,block);
+}
+
+//
+// A FOR leaf is written with its least key as its base, and as few
+// bits per key as the rest take, which may be fewer than it has in
+// memory
+//
+ERROR_T BTreeNode::SerializeDeltas(BufferCache *b, const SIZE_T blocknum, Block &block) const
+{
+  NodeMetadata out=info;
+  char *outdata=(char*)block.data+info.GetHeaderSize();
+  const SIZE_T n=info.numkeys;
+  uint64_t *deltas=new uint64_t [n>0 ? n : 1];
+  uint64_t lo=0, hi=0;
+
+  deltapack_unpack(DeltaKeys(data),info.deltabits,0,n,deltas);
+  for (SIZE_T i=0;i<n;i++) { 
+    if (i==0 || deltas[i]<lo) { 
+      lo=deltas[i];
+    }
+    if (i==0 || deltas[i]>hi) { 
+      hi=deltas[i];
+    }
+  }
+  for (SIZE_T i=0;i<n;i++) { 
+    deltas[i]-=lo;
+  }
+  out.deltabits=deltapack_bits(hi-lo);
+
+  // the values at the end stay where they are
+  memcpy(outdata,data,info.GetNumDataBytes());
+  SetDeltaBase(outdata,DeltaBase(data)+lo);
+  deltapack_pack(DeltaKeys(outdata),out.deltabits,0,n,deltas);
+  delete [] deltas;
+
+  out.Encode((char*)block.data);
+
+  return b->WriteBlock(blocknum,block);
+}
+
+//
+// Shrink a PREFIX node's prefix and padding in place to what it 
+// shares with k, if need be, so that k can be set in it.
+// ERROR_NOSPACE if the keys no longer fit.
+//
+ERROR_T BTreeNode::MakeRoomForKey(const KEY_T &k)
+{
+  const SIZE_T plen=info.prefixlen;
+  const SIZE_T pad=info.padlen;
+  const SIZE_T q=CommonPrefix(data,(const char*)k.data,plen);
+  const SIZE_T z=TrailingZeros((const char*)k.data,info.keysize,pad);
+  const SIZE_T newwidth=info.keysize-q-z;
+
+  if (q+info.numkeys*newwidth+PrefixTailBytes(info,info.numkeys) > info.GetNumDataBytes()) { 
+    return ERROR_NOSPACE;
+  }
+
+  if (q<plen || z<pad) { 
+    // Key 0 grows backwards over the end of the prefix, so it's
+    // already in place, less its zeros.  The others move up, the 
+    // last one first.
+    const SIZE_T width=info.GetKeyWidth();
+    for (SIZE_T i=info.numkeys;i>0;i--) { 
+      char *to=data+q+(i-1)*newwidth;
+      if (i>1) { 
+	memmove(to+(plen-q),data+plen+(i-1)*width,width);
+	memcpy(to,data+q,plen-q);
+      }
+      memset(to+(plen-q)+width,0,pad-z);
+    }
+    info.prefixlen=q;
+    info.padlen=z;
+  }
+
+  return ERROR_NOERROR;
+}
+
+//
+// Set the ith key of a FOR leaf to k, first lowering the base and
+// widening the keys in place to what they and k take, if need be.  
+// ERROR_NOSPACE if the keys no longer fit.
+//
+ERROR_T BTreeNode::SetDelta(const SIZE_T offset, const KEY_T &k)
+{
+  const SIZE_T n=info.numkeys;
+  const uint64_t x=KeyInteger((const char*)k.data,k.length,info.keysize);
+  const uint64_t base=DeltaBase(data);
+
+  if (x>=base && x-base<=deltapack_mask(info.deltabits)) { 
+    deltapack_put(DeltaKeys(data),info.deltabits,offset,x-base);
+    return ERROR_NOERROR;
+  }
+
+  // the key being replaced doesn't count
+  uint64_t *keys=new uint64_t [n];
+  uint64_t lo=x, hi=x;
+
+  deltapack_unpack(DeltaKeys(data),info.deltabits,0,n,keys);
+  for (SIZE_T i=0;i<n;i++) { 
+    keys[i]= i==offset ? x : base+keys[i];
+    lo= keys[i]<lo ? keys[i] : lo;
+    hi= keys[i]>hi ? keys[i] : hi;
+  }
+
+  const SIZE_T bits=deltapack_bits(hi-lo);
+  if (n>DeltaSlots(info,bits)) { 
+    delete [] keys;
+    return ERROR_NOSPACE;
+  }
+  for (SIZE_T i=0;i<n;i++) { 
+    keys[i]-=lo;
+  }
+  SetDeltaBase(data,lo);
+  deltapack_pack(DeltaKeys(data),bits,0,n,keys);
+  info.deltabits=bits;
+  delete [] keys;
+
+  return ERROR_NOERROR;
+}
+
+//
+// Room for a cell of len bytes in a SLOTTED node, compacting its
+// heap if need be.  The cell's offset, or 0 if it doesn't fit.
+//
+SIZE_T BTreeNode::AllocateCell(const SIZE_T len)
+{
+  const bool leaf = info.nodetype==BTREE_LEAF_NODE;
+  const SIZE_T dirend=info.GetPtrSize()+info.numkeys*SlotSize(info,leaf);
+
+  if (info.heaptop<dirend+len) { 
+    CompactCells();
+    if (info.heaptop<dirend+len) { 
+      return 0;
+    }
+  }
+  info.heaptop-=len;
+  return info.heaptop;
+}
+
+//
+// Move the cells of a SLOTTED node's keys to the end of the block,
+// leaving no room between them for cells that are no longer used
+//
+void BTreeNode::CompactCells()
+{
+  const bool leaf = info.nodetype==BTREE_LEAF_NODE;
+  const SIZE_T n=info.GetNumDataBytes();
+  char *old=new char [n];
+  SIZE_T top=n;
+
+  memcpy(old,data,n);
+  for (SIZE_T i=0;i<info.numkeys;i++) { 
+    char *slot=LayoutSlot(info,data,i);
+    SIZE_T cell=SlotField(slot,SLOT_CELL);
+    if (cell==0) { 
+      // not set yet
+      continue;
+    }
+    SIZE_T len=SlotField(slot,SLOT_KEYLEN)+(leaf ? SlotValLength(slot) : 0);
+    top-=len;
+    memcpy(data+top,old+cell,len);
+    SetSlotField(slot,SLOT_CELL,top);
+  }
+  info.heaptop=top;
+  delete [] old;
+}
+
+//
+// Write the ith key and value (vlen is 0 in an interior node) of a 
+// SLOTTED node, into the cell they have if they are the same size, 
+// otherwise into a new one.  k and v must not be in the node.  If
+// overflow, v is a reference to the value (see btree_ds.h).
+//
+ERROR_T BTreeNode::SetSlotted(const SIZE_T offset, const char *k, const SIZE_T klen, 
+			      const char *v, const SIZE_T vlen, const bool overflow)
+{
+  if (LayoutKey(info,data,offset)==0) { 
+    return ERROR_NOMEM;
+  }
+  if (klen>info.keysize || vlen>info.GetInlineValueSize()) { 
+    return ERROR_SIZE;
+  }
+
+  char *slot=LayoutSlot(info,data,offset);
+  SIZE_T cell=SlotField(slot,SLOT_CELL);
+
+  if (cell==0 || SlotField(slot,SLOT_KEYLEN)+SlotValLength(slot)!=klen+vlen) { 
+    cell=AllocateCell(klen+vlen);
+    if (cell==0) { 
+      return ERROR_NOSPACE;
+    }
+  }
+  // an empty key or value may come with no bytes at all
+  if (klen) { 
+    memcpy(data+cell,k,klen);
+  }
+  if (vlen) { 
+    memcpy(data+cell+klen,v,vlen);
+  }
+  SetSlotField(slot,SLOT_CELL,cell);
+  SetSlotField(slot,SLOT_KEYLEN,klen);
+  SetSlotField(slot,SLOT_VALLEN,overflow ? vlen|SLOT_OVERFLOW : vlen);
+
+  return ERROR_NOERROR;
+}
+
+char * BTreeNode::ResolveKey(const SIZE_T offset) const
+{
+  return LayoutKey(info,data,offset);
+}
+
+
+char * BTreeNode::ResolvePtr(const SIZE_T offset) const
+{
+  return LayoutPtr(info,data,offset);
+}
+
+
+
+char * BTreeNode::ResolveVal(const SIZE_T offset) const
+{
+  return LayoutVal(info,data,offset);
+}
+
+
+
+char * BTreeNode::ResolveKeyVal(const SIZE_T offset) const
+{
+  return ResolveKey(offset);
+}
+
+SIZE_T BTreeNode::GetNumSlotsWith(const KEY_T &key) const
+{
+  return LayoutSlotsWith(info,data,key);
+}
+
+//
+// Half the keys, or, in a SLOTTED node, the fewest keys that take at
+// least half its bytes, so that neither half has more than half the
+// bytes plus one of the largest keys.  Each half keeps at least one 
+// key, and the left half two, since an interior split then gives its
+// last key to the parent.
+//
+SIZE_T BTreeNode::GetSplitOffset() const
+{
+  const SIZE_T n=info.numkeys;
+
+  if (info.format!=BTREE_FORMAT_SLOTTED || n<3) { 
+    return (n+1)/2;
+  }
+
+  SIZE_T total=0, left=0, m=0;
+  for (SIZE_T i=0;i<n;i++) { 
+    total+=SlottedBytes(info,data,i);
+  }
+  while (m<n && 2*left<total) { 
+    left+=SlottedBytes(info,data,m);
+    m++;
+  }
+  return m<2 ? 2 : m>n-1 ? n-1 : m;
+}
+
+SIZE_T BTreeNode::GetKeyLength(const SIZE_T offset) const
+{
+  return LayoutKeyLength(info,data,offset);
+}
+
+SIZE_T BTreeNode::GetValLength(const SIZE_T offset) const
+{
+  return LayoutValLength(info,data,offset);
+}
+
+bool BTreeNode::IsOverflow(const SIZE_T offset) const
+{
+  return LayoutIsOverflow(info,data,offset);
+}
+
+ERROR_T BTreeNode::GetOverflow(const SIZE_T offset, SIZE_T &block, SIZE_T &length) const
+{
+  return LayoutGetOverflow(info,data,offset,block,length);
+}
+
+int BTreeNode::CompareKey(const SIZE_T offset, const KEY_T &key, const KeyOrder *order) const
+{
+  return LayoutCompareKey(info,data,offset,(const char*)key.data,key.length,order);
+}
+
+int BTreeNode::CompareKey(const SIZE_T offset, const char *key, const SIZE_T keylen,
+			   const KeyOrder *order) const
+{
+  return LayoutCompareKey(info,data,offset,key,keylen,order);
+}
+
+int BTreeNode::CompareKeys(const SIZE_T i, const SIZE_T j, const KeyOrder *order) const
+{
+  return LayoutCompareKeys(info,data,i,j,order);
+}
+
+SIZE_T BTreeNode::FindKey(const KEY_T &key, KeySearchKernel kernel, const KeyOrder *order,
+			  KeySearchStats *stats) const
+{
+  return LayoutSearch(info,data,key,false,kernel,order,stats);
+}
+
+SIZE_T BTreeNode::FindChild(const KEY_T &key, KeySearchKernel kernel, const KeyOrder *order,
+			  KeySearchStats *stats) const
+{
+  return LayoutSearch(info,data,key,true,kernel,order,stats);
+}
+
+ERROR_T BTreeNode::GetKey(const SIZE_T offset, KEY_T &k) const
+{
+  return LayoutGetKey(info,data,offset,k);
+}
+
+ERROR_T BTreeNode::GetPtr(const SIZE_T offset, SIZE_T &ptr) const
+{
+  char *p=ResolvePtr(offset);
+
+  if (p==0) { 
+    return ERROR_NOMEM;
+  }
+  
+  ptr=DecodePtr(info,p);
+  return ERROR_NOERROR;
+}
+
+ERROR_T BTreeNode::GetVal(const SIZE_T offset, VALUE_T &v) const
+{
+  char *p=ResolveVal(offset);
+
+  if (p==0) { 
+    return ERROR_NOMEM;
+  }
+  
+  SIZE_T len=LayoutValLength(info,data,offset);
+  v.Resize(len,false);
+  memcpy(v.data,p,len);
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T BTreeNode::GetKeyVal(const SIZE_T offset, KeyValuePair &p) const
+{
+  ERROR_T rc= GetKey(offset,p.key);
+
+  if (rc!=ERROR_NOERROR) { 
+    return rc; 
+  } else {
+    return GetVal(offset,p.value);
+  }
+}
+
+
+ERROR_T BTreeNode::SetKey(const SIZE_T offset, const KEY_T &k)
+{
+  if (info.format==BTREE_FORMAT_SLOTTED) { 
+    // a leaf's value goes into the key's new cell with it
+    VALUE_T v;
+    if (info.nodetype==BTREE_LEAF_NODE) { 
+      ERROR_T rc=GetVal(offset,v);
+      if (rc!=ERROR_NOERROR) { 
+	return rc;
+      }
+    }
+    return SetSlotted(offset,(const char*)k.data,k.length,(const char*)v.data,v.length,
+		      IsOverflow(offset));
+  }
+
+  if (PackedLeaf(info)) { 
+    if (offset>=info.numkeys) { 
+      return ERROR_NOMEM;
+    }
+    return SetDelta(offset,k);
+  }
+
+  if (info.format==BTREE_FORMAT_PREFIX && ResolveKey(offset)!=0) { 
+    ERROR_T rc=MakeRoomForKey(k);
+    if (rc!=ERROR_NOERROR) { 
+      return rc;
+    }
+  }
+
+  char *p=ResolveKey(offset);
+
+  if (p==0) { 
+    return ERROR_NOMEM;
+  }
+
+  memcpy(p,k.data+info.prefixlen,info.GetKeyWidth());
+
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T BTreeNode::SetPtr(const SIZE_T offset, const SIZE_T &ptr)
+{
+  char *p=ResolvePtr(offset);
+
+  if (p==0) { 
+    return ERROR_NOMEM;
+  }
+
+  if (info.GetPtrSize()==sizeof(uint32_t)) { 
+    if (ptr>0xffffffffULL) { 
+      // a narrow index can't point past 4G blocks
+      return ERROR_SIZE;
+    }
+    uint32_t narrow=ptr;
+    memcpy(p,&narrow,sizeof(narrow));
+  } else {
+    uint64_t wide=ptr;
+    memcpy(p,&wide,sizeof(wide));
+  }
+
+  return ERROR_NOERROR;
+}
+
+
+
+ERROR_T BTreeNode::SetVal(const SIZE_T offset, const VALUE_T &v)
+{
+  char *p=ResolveVal(offset);
+  
+  if (p==0) { 
+    return ERROR_NOMEM;
+  }
+
+  if (info.format==BTREE_FORMAT_SLOTTED) { 
+    KEY_T k;
+    GetKey(offset,k);
+    return SetSlotted(offset,(const char*)k.data,k.length,(const char*)v.data,v.length);
+  }
+  
+  memcpy(p,v.data,info.valuesize);
+  
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T BTreeNode::SetKeyVal(const SIZE_T offset, const KeyValuePair &p)
+{
+  if (info.format==BTREE_FORMAT_SLOTTED && info.nodetype==BTREE_LEAF_NODE) { 
+    return SetSlotted(offset,(const char*)p.key.data,p.key.length,
+		      (const char*)p.value.data,p.value.length);
+  }
+
+  ERROR_T rc=SetKey(offset,p.key);
+
+  if (rc!=ERROR_NOERROR) { 
+    return rc;
+  } else {
+    return SetVal(offset,p.value);
+  }
+}
+
+
+ERROR_T BTreeNode::SetKeyOverflow(const SIZE_T offset, const KEY_T &k, const SIZE_T block,
+				  const SIZE_T length)
+{
+  if (info.format!=BTREE_FORMAT_SLOTTED || info.nodetype!=BTREE_LEAF_NODE) { 
+    return ERROR_BADNODETYPE;
+  }
+
+  uint64_t ref[2] = { block, length };
+  return SetSlotted(offset,(const char*)k.data,k.length,(const char*)ref,sizeof(ref),true);
+}
+
+
+
+
+ERROR_T BTreeNode::InsertSlot(const SIZE_T offset, const NodeShape *shape)
+{
+  const bool leaf = info.nodetype==BTREE_LEAF_NODE;
+  const SIZE_T n=info.numkeys;
+
+  if (info.nodetype!=BTREE_LEAF_NODE && info.nodetype!=BTREE_INTERIOR_NODE && 
+      info.nodetype!=BTREE_ROOT_NODE) { 
+    return ERROR_NOMEM;
+  }
+  assert(offset<=n);
+
+  if (info.format==BTREE_FORMAT_SLOTTED) { 
+    const SIZE_T size=SlotSize(info,leaf);
+    if (info.heaptop<info.GetPtrSize()+(n+1)*size) { 
+      CompactCells();
+      if (info.heaptop<info.GetPtrSize()+(n+1)*size) { 
+	return ERROR_NOSPACE;
+      }
+    }
+    char *slot=LayoutSlot(info,data,offset);
+    memmove(slot+size,slot,(n-offset)*size);
+    memset(slot,0,size);
+    info.numkeys++;
+    return ERROR_NOERROR;
+  }
+
+  if (info.format==BTREE_FORMAT_PREFIX) { 
+    if (info.prefixlen+(n+1)*info.GetKeyWidth()+PrefixTailBytes(info,n+1)>info.GetNumDataBytes()) { 
+      return ERROR_NOSPACE;
+    }
+  } else if (PackedLeaf(info)) { 
+    if (n+1>DeltaSlots(info,info.deltabits)) { 
+      return ERROR_NOSPACE;
+    }
+  } else if (n+1>(leaf ? info.GetNumSlotsAsLeaf() : info.GetNumSlotsAsInterior())) { 
+    return ERROR_NOSPACE;
+  }
+
+  if (shape && info.format==BTREE_FORMAT_SOA) { 
+    shape->insertslot(data,leaf,n,offset);
+    info.numkeys++;
+    return ERROR_NOERROR;
+  }
+
+  // The stored bytes move as they are, so a PREFIX node's prefix and
+  // padding stay the same, as do a FOR leaf's base and width
+  const SIZE_T width=info.GetKeyWidth();
+  info.numkeys++;
+  for (SIZE_T i=n;i>offset;i--) { 
+    if (PackedLeaf(info)) { 
+      deltapack_put(DeltaKeys(data),info.deltabits,i,deltapack_get(DeltaKeys(data),info.deltabits,i-1));
+    } else {
+      memcpy(LayoutKey(info,data,i),LayoutKey(info,data,i-1),width);
+    }
+    if (leaf) { 
+      memcpy(LayoutVal(info,data,i),LayoutVal(info,data,i-1),info.valuesize);
+    } else {
+      memcpy(LayoutPtr(info,data,i+1),LayoutPtr(info,data,i),info.GetPtrSize());
+    }
+  }
+  return ERROR_NOERROR;
+}
+
+ERROR_T BTreeNode::RemoveSlot(const SIZE_T offset, const NodeShape *shape)
+{
+  const bool leaf = info.nodetype==BTREE_LEAF_NODE;
+  const SIZE_T n=info.numkeys;
+
+  if (LayoutKey(info,data,offset)==0) { 
+    return ERROR_NOMEM;
+  }
+
+  if (info.format==BTREE_FORMAT_SLOTTED) { 
+    // the cell is reclaimed when the heap is next compacted
+    const SIZE_T size=SlotSize(info,leaf);
+    char *slot=LayoutSlot(info,data,offset);
+    memmove(slot,slot+size,(n-offset-1)*size);
+    info.numkeys--;
+    return ERROR_NOERROR;
+  }
+
+  if (shape && info.format==BTREE_FORMAT_SOA) { 
+    shape->removeslot(data,leaf,n,offset);
+    info.numkeys--;
+    return ERROR_NOERROR;
+  }
+
+  const SIZE_T width=info.GetKeyWidth();
+  for (SIZE_T i=offset;i+1<n;i++) { 
+    if (PackedLeaf(info)) { 
+      deltapack_put(DeltaKeys(data),info.deltabits,i,deltapack_get(DeltaKeys(data),info.deltabits,i+1));
+    } else {
+      memcpy(LayoutKey(info,data,i),LayoutKey(info,data,i+1),width);
+    }
+    if (leaf) { 
+      memcpy(LayoutVal(info,data,i),LayoutVal(info,data,i+1),info.valuesize);
+    } else {
+      memcpy(LayoutPtr(info,data,i+1),LayoutPtr(info,data,i+2),info.GetPtrSize());
+    }
+  }
+  info.numkeys--;
+  return ERROR_NOERROR;
+}
+
+
+ostream & BTreeNode::Print(ostream &os) const 
+{
+  os << "BTreeNode(info="<<info;
+  if (info.nodetype!=BTREE_UNALLOCATED_BLOCK && info.nodetype!=BTREE_SUPERBLOCK) { 
+    os <<", ";
+    if (info.nodetype==BTREE_INTERIOR_NODE || info.nodetype==BTREE_ROOT_NODE) {
+      SIZE_T ptr;
+      KEY_T key;
+      os << "pointers_and_values=(";
+      if (info.numkeys>0) { // ==0 implies an empty root node
 	for (SIZE_T i=0;i<info.numkeys;i++) {
 	  GetPtr(i,ptr);
 	  os<<ptr<<", ";
@@ -346,3 +1759,153 @@ ostream & BTreeNode::Print(ostream &os) const
   os <<")";
   return os;
 }
+
+
+
+BTreeNodeView::BTreeNodeView() : cache(0), block(0), data(0)
+{
+  info.nodetype=BTREE_UNALLOCATED_BLOCK;
+  info.format=BTREE_FORMAT_CURRENT;
+  info.prefixlen=0;
+  info.padlen=0;
+  info.heaptop=0;
+  info.deltabits=0;
+}
+
+BTreeNodeView::~BTreeNodeView()
+{
+  Release();
+}
+
+ERROR_T BTreeNodeView::View(BufferCache *b, const SIZE_T blocknum)
+{
+  const Block *frame;
+  ERROR_T rc;
+
+  Release();
+
+  rc=b->PinBlock(blocknum,frame);
+
+  if (rc!=ERROR_NOERROR) { 
+    return rc;
+  }
+
+  cache=b;
+  block=blocknum;
+
+  rc=info.Decode((const char*)frame->data);
+
+  if (rc!=ERROR_NOERROR) { 
+    Release();
+    return rc;
+  }
+
+  assert(b->GetBlockSize()==info.blocksize);
+
+  data=(const char*)frame->data+info.GetHeaderSize();
+
+  return ERROR_NOERROR;
+}
+
+void BTreeNodeView::Release()
+{
+  if (cache) { 
+    cache->UnpinBlock(block);
+  }
+  cache=0;
+  data=0;
+}
+
+const char * BTreeNodeView::ResolveKey(const SIZE_T offset) const
+{
+  return LayoutKey(info,data,offset);
+}
+
+const char * BTreeNodeView::ResolveVal(const SIZE_T offset) const
+{
+  return LayoutVal(info,data,offset);
+}
+
+ERROR_T BTreeNodeView::GetKey(const SIZE_T offset, KEY_T &k) const
+{
+  return LayoutGetKey(info,data,offset,k);
+}
+
+ERROR_T BTreeNodeView::GetPtr(const SIZE_T offset, SIZE_T &ptr) const
+{
+  const char *p=LayoutPtr(info,data,offset);
+
+  if (p==0) { 
+    return ERROR_NOMEM;
+  }
+  
+  ptr=DecodePtr(info,p);
+  return ERROR_NOERROR;
+}
+
+ERROR_T BTreeNodeView::GetVal(const SIZE_T offset, VALUE_T &v) const
+{
+  const char *p=ResolveVal(offset);
+
+  if (p==0) { 
+    return ERROR_NOMEM;
+  }
+  
+  SIZE_T len=LayoutValLength(info,data,offset);
+  v.Resize(len,false);
+  memcpy(v.data,p,len);
+  return ERROR_NOERROR;
+}
+
+SIZE_T BTreeNodeView::GetNumSlotsWith(const KEY_T &key) const
+{
+  return LayoutSlotsWith(info,data,key);
+}
+
+SIZE_T BTreeNodeView::GetKeyLength(const SIZE_T offset) const
+{
+  return LayoutKeyLength(info,data,offset);
+}
+
+SIZE_T BTreeNodeView::GetValLength(const SIZE_T offset) const
+{
+  return LayoutValLength(info,data,offset);
+}
+
+bool BTreeNodeView::IsOverflow(const SIZE_T offset) const
+{
+  return LayoutIsOverflow(info,data,offset);
+}
+
+ERROR_T BTreeNodeView::GetOverflow(const SIZE_T offset, SIZE_T &block, SIZE_T &length) const
+{
+  return LayoutGetOverflow(info,data,offset,block,length);
+}
+
+int BTreeNodeView::CompareKey(const SIZE_T offset, const KEY_T &key, const KeyOrder *order) const
+{
+  return LayoutCompareKey(info,data,offset,(const char*)key.data,key.length,order);
+}
+
+int BTreeNodeView::CompareKey(const SIZE_T offset, const char *key, const SIZE_T keylen,
+			   const KeyOrder *order) const
+{
+  return LayoutCompareKey(info,data,offset,key,keylen,order);
+}
+
+int BTreeNodeView::CompareKeys(const SIZE_T i, const SIZE_T j, const KeyOrder *order) const
+{
+  return LayoutCompareKeys(info,data,i,j,order);
+}
+
+SIZE_T BTreeNodeView::FindKey(const KEY_T &key, KeySearchKernel kernel, const KeyOrder *order,
+			  KeySearchStats *stats) const
+{
+  return LayoutSearch(info,data,key,false,kernel,order,stats);
+}
+
+SIZE_T BTreeNodeView::FindChild(const KEY_T &key, KeySearchKernel kernel, const KeyOrder *order,
+			  KeySearchStats *stats) const
+{
+  return LayoutSearch(info,data,key,true,kernel,order,stats);
+}
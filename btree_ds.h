@@ -4,6 +4,9 @@
 #include <iostream>
 #include "global.h"
 #include "block.h"
+#include "keysearch.h"
+#include "keyorder.h"
+#include "keycodec.h"
 
 using namespace std;
 
@@ -13,6 +16,30 @@ using namespace std;
 #define BTREE_ROOT_NODE 2
 #define BTREE_INTERIOR_NODE 3
 #define BTREE_LEAF_NODE 4
+#define BTREE_OVERFLOW_BLOCK 5
+
+// On-disk node formats
+//
+// The format lives in the upper 16 bits of the first word of each
+// block, above the node type.  Blocks written before there were
+// formats hold only the node type there and so read as NARROW.
+// The superblock's format is the format of the whole index, and
+// every node allocated by the index is written in that format.
+#define BTREE_FORMAT_NARROW 0   // 32 bit header fields and pointers
+#define BTREE_FORMAT_WIDE 1     // 64 bit header fields and pointers
+#define BTREE_FORMAT_SOA 2      // WIDE, with keys stored apart from 
+                                // pointers and values (see below)
+#define BTREE_FORMAT_PREFIX 3   // SOA, with the prefix common to a node's
+                                // keys stored once (see below)
+#define BTREE_FORMAT_SLOTTED 4  // WIDE, with keys and values of any length
+                                // up to keysize and valuesize (see below)
+#define BTREE_FORMAT_FOR 5      // SOA, with leaf keys stored as bit packed
+                                // differences from a base key (see below)
+#define BTREE_FORMAT_CURRENT BTREE_FORMAT_PREFIX
+
+// The format called name (as NodeMetadata::Print shows it, in any
+// case), or -1 if there is none
+int NodeFormatByName(const char *name);
 
 
 typedef Block Buffer;
@@ -23,19 +50,43 @@ typedef KeyOrValue VALUE_T;
 
 class BufferCache;
 struct KeyValuePair;
+struct NodeShape;
 
 struct NodeMetadata {
   int nodetype;
+  int format;     // not a field of its own on disk, see above
   SIZE_T keysize; 
   SIZE_T valuesize;
   SIZE_T blocksize;
   SIZE_T rootnode; //meaningful only for superblock
-  SIZE_T freelist; //meaningful only for superblock or a free block
-  SIZE_T numkeys;
-
+  SIZE_T freelist; //meaningful only for superblock, a free block, or an overflow block
+  SIZE_T numkeys;  //bytes of the value in an overflow block
+  SIZE_T prefixlen; //PREFIX format only, bytes of key stored once
+  SIZE_T padlen;    //PREFIX format only, zero bytes at the end of keys, not stored
+  SIZE_T heaptop;   //SLOTTED format only, offset in the data of the lowest cell
+  SIZE_T deltabits; //FOR format only, bits per key stored in a leaf
+  KeyOrder keyorder; //meaningful only for superblock, kept just past its header
+  KeyCodec keycodec; //meaningful only for superblock, kept just past its key order
+
+  SIZE_T GetHeaderSize() const;   // bytes of metadata at the start of the block
+  SIZE_T GetPtrSize() const;      // bytes per stored block pointer
+  SIZE_T GetKeyWidth() const;     // bytes stored per key (less prefix and padding)
   SIZE_T GetNumDataBytes() const;
   SIZE_T GetNumSlotsAsInterior() const;
   SIZE_T GetNumSlotsAsLeaf() const;
+  // Largest value a leaf keeps in place (valuesize except in SLOTTED)
+  SIZE_T GetInlineValueSize() const;
+
+  // Whether the format's nodes can hold keys of keysize and values of
+  // valuesize (SLOTTED and FOR limit them, see below), and the key 
+  // order's columns fit in keysize
+  bool    SizesFit() const;
+  // Why they don't, or 0 if they do
+  const char *SizesProblem() const;
+
+  // Convert to and from the on-disk header of the node's format
+  void    Encode(char *buf) const;
+  ERROR_T Decode(const char *buf);
 
   ostream &Print(ostream &rhs) const;
 			  
@@ -45,6 +96,14 @@ struct NodeMetadata {
 inline ostream & operator<< (ostream &os, const NodeMetadata &node) { return node.Print(os); }
 
 
+// <0, 0, >0 as key a (of alen bytes) is less than, equal to, or
+// greater than key b, in order, or in KEYORDER_BINARY if order is 0
+// (see keyorder.h).  Nodes compare keys in place this way, without
+// copying them.
+int CompareKeyBytes(const char *a, const SIZE_T alen, const char *b, const SIZE_T blen,
+		    const KeyOrder *order=0);
+
+
 
 //
 // Interior node:
@@ -56,6 +115,97 @@ inline ostream & operator<< (ostream &os, const NodeMetadata &node) { return nod
 // PTR* KEY VALUE KEY VALUE KEY VALUE
 //
 // *Here this pointer is not used
+//
+// In BTREE_FORMAT_SOA the keys are instead one array, so a search
+// touches only keys, followed by the pointers or values.  Each array
+// has room for the node's full number of slots:
+//
+// Interior node:
+//
+// KEY KEY KEY ... PTR PTR PTR PTR ...
+//
+// Leaf:
+//
+// PTR* KEY KEY KEY ... VALUE VALUE VALUE ...
+//
+// In BTREE_FORMAT_PREFIX the first prefixlen bytes, which all of the
+// node's keys share, are stored once, followed by the rest of each
+// key (its suffix), less the last padlen bytes, which are zero in all
+// of them.  Separators are chosen to be short and zero padded (see 
+// BTreeIndex::InsertInternal), so interior nodes often have a long
+// padlen.  Pointers and values are stored backwards from the end of
+// the block, so that nothing has to know the node's capacity to find
+// them, and the prefix and padding can shrink in place when a key 
+// that doesn't share them is set.  Serialize stores the longest 
+// common prefix and padding of the keys the node has.  Keys of a 
+// PREFIX index must be shorter than 64K.
+//
+// Interior node:
+//
+// PREFIX SUFFIX SUFFIX ... ... PTR PTR PTR
+//
+// Leaf:
+//
+// PREFIX SUFFIX SUFFIX ... ... VALUE VALUE PTR*
+//
+// The more the keys share, the more a node can hold, but never more
+// than twice, less two, what it could hold with no prefix.  That way 
+// either half of a split node, plus a key that shares nothing with
+// the others, still fits.
+//
+// In BTREE_FORMAT_SLOTTED keysize and valuesize are only the largest
+// key and value the index takes.  Each key (and its value, in a leaf)
+// is a cell in a heap that grows down from the end of the block, and
+// a directory of slots, one per key in key order, grows up to meet it.
+// A leaf slot is the u16 offset of the cell, and the u16 lengths of
+// its key and value.  An interior slot is the u16 offset and key 
+// length, and the pointer after the key.  Cells that are no longer 
+// used are only reclaimed when a new one doesn't fit, by compacting 
+// the heap in place.  A node is full when a key plus the largest 
+// value (or a pointer) doesn't fit, so how many keys it holds depends
+// on their lengths.  The largest key and value, with their slot, may 
+// take no more than a quarter of the node, so that either half of a
+// node split by bytes, plus one more of them, still fits, and block 
+// sizes are limited to 64K.
+//
+// A SLOTTED leaf keeps in place only values of up to an eighth of the
+// node (see GetInlineValueSize), so valuesize may be larger than a
+// block.  A longer value is stored in a chain of overflow blocks, 
+// and its cell holds just a u64 first block and u64 length, with the
+// top bit of the slot's value length set.  An overflow block holds 
+// numkeys bytes of the value in its data, and freelist is the next 
+// block of the chain, or 0.  A few large values then don't shrink 
+// every leaf, and searching for keys reads none of them.
+//
+// Interior node:
+//
+// PTR SLOT SLOT SLOT ... ... KEY KEY KEY
+//
+// Leaf:
+//
+// PTR* SLOT SLOT SLOT ... ... KEY VALUE KEY VALUE
+//
+// In BTREE_FORMAT_FOR (frame of reference) interior nodes are SOA.
+// A leaf's keys, which must be no longer than 8 bytes, are taken as
+// big endian unsigned integers, the way they compare.  The leaf 
+// stores its least key as a u64 base, and each key as its difference
+// from the base, bit packed (see deltapack.h) at deltabits bits, as
+// few as the largest difference takes.  Values are stored backwards
+// from the end of the block, as in PREFIX.  Setting a key the base 
+// and width can't hold lowers the base or widens the keys in place,
+// and Serialize stores the highest base and narrowest width the keys
+// allow.  Leaves are searched without unpacking their keys, by taking
+// the base from the key searched for (see deltapack_search).  Keys 
+// that are close together, like sequence numbers and timestamps, 
+// take a few bits each, and a leaf holds several times as many, but 
+// never more than twice, less two, what it could hold at full width,
+// for the same reason as in PREFIX.  Only a binary index (see 
+// keyorder.h) can be FOR.
+//
+// Leaf:
+//
+// BASE DELTA DELTA DELTA ... ... VALUE VALUE PTR*
+//
 
 
 struct BTreeNode {
@@ -71,20 +221,53 @@ struct BTreeNode {
   //
   // Note: This destructor is INTENTIONALLY left non-virtual
   //       This class must NOT have a vtable pointer
-  //         because we will serialize it directly to disk
   //
   ~BTreeNode();
-  BTreeNode(int node_type, SIZE_T key_size, SIZE_T value_size, SIZE_T block_size);
+  BTreeNode(int node_type, SIZE_T key_size, SIZE_T value_size, SIZE_T block_size,
+	    int format=BTREE_FORMAT_CURRENT);
   BTreeNode(const BTreeNode &rhs);
   BTreeNode & operator=(const BTreeNode &rhs);
   
   ERROR_T Serialize(BufferCache *b, const SIZE_T block) const;
   ERROR_T Unserialize(BufferCache *b, const SIZE_T block);
 
-  char *ResolveKey(const SIZE_T offset) const; // Gives a pointer to the ith key  (interior or leaf)
+  char *ResolveKey(const SIZE_T offset) const; // Gives a pointer to the ith key (its suffix if PREFIX)
   char *ResolvePtr(const SIZE_T offset) const; // Gives a pointer to the ith pointer (interior)
   char *ResolveVal(const SIZE_T offset) const; // Gives a pointer to the ith value (leaf)
-  char *ResolveKeyVal(const SIZE_T offset) const ; // Gives a pointer to the ith keyvalue pair (leaf)
+  char *ResolveKeyVal(const SIZE_T offset) const ; // Gives a pointer to the ith keyvalue pair (leaf, not SOA)
+
+  // How many keys the node could hold with key among them
+  // (SLOTTED: numkeys+1 if key fits, otherwise numkeys)
+  SIZE_T  GetNumSlotsWith(const KEY_T &key) const;
+  // Where to split the node: the first key of the right half
+  SIZE_T  GetSplitOffset() const;
+
+  // Lengths of the ith key and value (keysize and valuesize except
+  // in SLOTTED nodes)
+  SIZE_T  GetKeyLength(const SIZE_T offset) const;
+  SIZE_T  GetValLength(const SIZE_T offset) const;
+
+  // <0, 0, >0 as key is less than, equal to, or greater than the ith key
+  int     CompareKey(const SIZE_T offset, const KEY_T &key, const KeyOrder *order=0) const;
+  int     CompareKey(const SIZE_T offset, const char *key, const SIZE_T keylen,
+		     const KeyOrder *order=0) const;
+  // <0, 0, >0 as the ith key is less than, equal to, or greater than the jth
+  int     CompareKeys(const SIZE_T i, const SIZE_T j, const KeyOrder *order=0) const;
+  // Binary searches, comparing keys in place:
+  // where key is, or would be inserted (the first key >= key)
+  SIZE_T  FindKey(const KEY_T &key, KeySearchKernel kernel=0, const KeyOrder *order=0,
+		  KeySearchStats *stats=0) const;
+  // which pointer to follow to find key in an interior node 
+  // (the first key > key, since a separator is the first key of 
+  // the subtree to its right)
+  SIZE_T  FindChild(const KEY_T &key, KeySearchKernel kernel=0, const KeyOrder *order=0,
+		    KeySearchStats *stats=0) const;
+  // Given a kernel (see keysearch.h) for the index's key size, 
+  // these use it instead of comparing with memcmp.  Keys are in 
+  // binary order unless they're given the index's order, which 
+  // can't be given with a kernel.  Given the index's search
+  // statistics (see keysearch.h), they search by interpolation
+  // while the statistics say it pays, and add the search to them.
 
   ERROR_T GetKey(const SIZE_T offset, KEY_T &k) const ; // Gives the ith key  (interior or leaf)
   ERROR_T GetPtr(const SIZE_T offset, SIZE_T &p) const ;   // Gives the ith pointer (interior)
@@ -97,13 +280,93 @@ struct BTreeNode {
   ERROR_T SetVal(const SIZE_T offset, const VALUE_T &v); // Writes the ith value (leaf)
   ERROR_T SetKeyVal(const SIZE_T offset, const KeyValuePair &p); // Writes the ith key value pair (leaf)
 
+  // Whether the ith value of a SLOTTED leaf is out of line, and if it
+  // is, its chain's first block and its length (the value the above
+  // get and set is then the reference).  SetKeyOverflow writes the
+  // ith key, with a reference for its value.
+  bool    IsOverflow(const SIZE_T offset) const;
+  ERROR_T GetOverflow(const SIZE_T offset, SIZE_T &block, SIZE_T &length) const;
+  ERROR_T SetKeyOverflow(const SIZE_T offset, const KEY_T &k, const SIZE_T block, 
+			 const SIZE_T length);
+
+  // Add a key at offset, moving the keys from offset on, with their
+  // values (leaf) or the pointers after them (interior), up one.  The
+  // new key, value and pointer are then set with the above.
+  // ERROR_NOSPACE if the node is already full.
+  // Given the index's shape (see btree_nodet.h), it does the moving.
+  ERROR_T InsertSlot(const SIZE_T offset, const NodeShape *shape=0);
+  // Remove the key at offset, with its value or the pointer after it
+  ERROR_T RemoveSlot(const SIZE_T offset, const NodeShape *shape=0);
+
   ostream &Print(ostream &rhs) const;
+
+ private:
+  ERROR_T SerializePrefix(BufferCache *b, const SIZE_T block, Block &blk) const;
+  ERROR_T SerializeDeltas(BufferCache *b, const SIZE_T block, Block &blk) const;
+  ERROR_T MakeRoomForKey(const KEY_T &k);
+  ERROR_T SetDelta(const SIZE_T offset, const KEY_T &k);
+  SIZE_T  AllocateCell(const SIZE_T len);
+  void    CompactCells();
+  ERROR_T SetSlotted(const SIZE_T offset, const char *k, const SIZE_T klen, 
+		     const char *v, const SIZE_T vlen, const bool overflow=false);
 };
 
 
 inline ostream & operator<<(ostream &os, const BTreeNode &node) { return node.Print(os); }
 
 
+//
+// A read-only BTreeNode that is not a copy.  View pins the node's
+// block in the cache and interprets the frame in place, so looking 
+// at a node that is already cached copies and allocates nothing.
+// The block stays pinned until Release or destruction, so keep 
+// views short lived, and release them before the cache is detached.
+//
+// info is a copy of the header, and may be changed (e.g. to look at
+// the root as a leaf) without affecting the block.
+//
+class BTreeNodeView {
+ public:
+  NodeMetadata  info;
+ private:
+  BufferCache  *cache;
+  SIZE_T        block;
+  const char   *data;
+ public:
+  BTreeNodeView();
+  BTreeNodeView(const BTreeNodeView &rhs) { throw GenericException(); }
+  BTreeNodeView & operator=(const BTreeNodeView &rhs) { throw GenericException(); return *this; }
+  ~BTreeNodeView();
+
+  ERROR_T View(BufferCache *b, const SIZE_T block);
+  void    Release();
+
+  const char *ResolveKey(const SIZE_T offset) const;
+  const char *ResolveVal(const SIZE_T offset) const;
+
+  ERROR_T GetKey(const SIZE_T offset, KEY_T &k) const;
+  ERROR_T GetPtr(const SIZE_T offset, SIZE_T &p) const;
+  ERROR_T GetVal(const SIZE_T offset, VALUE_T &v) const;
+
+  // See BTreeNode
+  SIZE_T  GetNumSlotsWith(const KEY_T &key) const;
+  SIZE_T  GetKeyLength(const SIZE_T offset) const;
+  SIZE_T  GetValLength(const SIZE_T offset) const;
+  bool    IsOverflow(const SIZE_T offset) const;
+  ERROR_T GetOverflow(const SIZE_T offset, SIZE_T &block, SIZE_T &length) const;
+
+  // See BTreeNode
+  int     CompareKey(const SIZE_T offset, const KEY_T &key, const KeyOrder *order=0) const;
+  int     CompareKey(const SIZE_T offset, const char *key, const SIZE_T keylen,
+		     const KeyOrder *order=0) const;
+  int     CompareKeys(const SIZE_T i, const SIZE_T j, const KeyOrder *order=0) const;
+  SIZE_T  FindKey(const KEY_T &key, KeySearchKernel kernel=0, const KeyOrder *order=0,
+		  KeySearchStats *stats=0) const;
+  SIZE_T  FindChild(const KEY_T &key, KeySearchKernel kernel=0, const KeyOrder *order=0,
+		    KeySearchStats *stats=0) const;
+};
+
+
 
 
 
@@ -4,7 +4,7 @@
 
 void usage() 
 {
-  cerr << "usage: btree_init filestem cachesize keysize valuesize\n";
+  cerr << "usage: btree_init filestem cachesize keysize valuesize [format [keyorder [keycodec]]]\n";
 }
 
 
@@ -13,8 +13,11 @@ int main(int argc, char **argv)
   char *filestem;
   SIZE_T cachesize, keysize, valuesize;
   SIZE_T superblocknum;
+  int format=BTREE_FORMAT_CURRENT;
+  KeyOrder order;
+  KeyCodec codec;
 
-  if (argc!=5) { 
+  if (argc<5 || argc>8) { 
     usage();
     return -1;
   }
@@ -23,10 +26,22 @@ int main(int argc, char **argv)
   cachesize=atoi(argv[2]);
   keysize=atoi(argv[3]);
   valuesize=atoi(argv[4]);
+  if (argc>=6 && (format=NodeFormatByName(argv[5]))<0) { 
+    usage();
+    return -1;
+  }
+  if (argc>=7 && KeyOrderByName(argv[6],order)<0) { 
+    usage();
+    return -1;
+  }
+  if (argc==8 && KeyCodecByName(argv[7],codec)<0) { 
+    usage();
+    return -1;
+  }
 
   DiskSystem disk(filestem);
   BufferCache cache(&disk,cachesize);
-  BTreeIndex btree(keysize,valuesize,&cache);
+  BTreeIndex btree(keysize,valuesize,&cache,true,format,order,codec);
   
   ERROR_T rc;
 
@@ -36,7 +51,12 @@ int main(int argc, char **argv)
   }
 
   if ((rc=btree.Attach(0,true))!=ERROR_NOERROR) { 
-    cerr << "Can't attach to index with creation due to error "<<rc<<endl;
+    const char *why;
+    cerr << "Can't attach to index with creation due to error "<<rc;
+    if (btree.CheckCreate(&why)!=ERROR_NOERROR) { 
+      cerr << " ("<<why<<")";
+    }
+    cerr << endl;
     return -1;
   } else {
     cerr << "Index created!"<<endl;
@@ -0,0 +1,43 @@
+#include "btree_nodet.h"
+
+struct NodeShapeEntry {
+  SIZE_T    keysize;
+  SIZE_T    valuesize;
+  SIZE_T    blocksize;
+  SIZE_T    interiorslots;
+  SIZE_T    leafslots;
+  NodeShape shape;
+};
+
+#define NODE_SHAPE(K,V,B) \
+  { K, V, B, BTreeNodeT<K,V,B>::InteriorSlots, BTreeNodeT<K,V,B>::LeafSlots, \
+    { BTreeNodeT<K,V,B>::Search, BTreeNodeT<K,V,B>::InsertSlot, BTreeNodeT<K,V,B>::RemoveSlot } }
+
+#define NODE_SHAPES_V(K,B) \
+  NODE_SHAPE(K,4,B), NODE_SHAPE(K,8,B), NODE_SHAPE(K,12,B), NODE_SHAPE(K,16,B)
+
+#define NODE_SHAPES_K(B) \
+  NODE_SHAPES_V(4,B), NODE_SHAPES_V(8,B), NODE_SHAPES_V(16,B)
+
+// The common shapes: 4, 8 and 16 byte keys, 4 to 16 byte values, and
+// 512 byte to 4K blocks
+static const NodeShapeEntry shapes[] = {
+  NODE_SHAPES_K(512), NODE_SHAPES_K(1024), NODE_SHAPES_K(4096)
+};
+
+
+const NodeShape *nodeshape_choose(const NodeMetadata &info)
+{
+  if (info.format!=BTREE_FORMAT_SOA) {
+    return 0;
+  }
+  for (unsigned i=0;i<sizeof(shapes)/sizeof(shapes[0]);i++) {
+    const NodeShapeEntry &e=shapes[i];
+    if (e.keysize==info.keysize && e.valuesize==info.valuesize && e.blocksize==info.blocksize) {
+      // the layouts had better agree
+      assert(e.interiorslots==info.GetNumSlotsAsInterior() && e.leafslots==info.GetNumSlotsAsLeaf());
+      return &e.shape;
+    }
+  }
+  return 0;
+}
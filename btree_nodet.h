@@ -0,0 +1,104 @@
+#ifndef _btree_nodet
+#define _btree_nodet
+
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+
+#include "global.h"
+#include "keysearch.h"
+#include "btree_ds.h"
+
+//
+// Node code specialized for one shape of BTREE_FORMAT_SOA node
+//
+// BTreeNodeT<KeySize,ValueSize,BlockSize> is the SOA layout (see
+// btree_ds.h) with everything the generic code works out from the
+// node's metadata on every access, capacity and where each array
+// starts, fixed at compile time.  Its search and its shifts for
+// adding and removing keys are instantiated for common shapes, and an
+// index picks its shape's once, at Attach, the way it picks a search
+// kernel.
+//
+// Keys are compared the way memcmp does, as they are everywhere else.
+//
+template <SIZE_T KeySize, SIZE_T ValueSize, SIZE_T BlockSize>
+struct BTreeNodeT {
+  // the WIDE header (see btree_ds.cc) and pointers
+  static const SIZE_T HeaderSize = 2*sizeof(uint32_t)+6*sizeof(uint64_t);
+  static const SIZE_T PtrSize = sizeof(uint64_t);
+  static const SIZE_T DataBytes = BlockSize-HeaderSize;
+  static const SIZE_T InteriorSlots = (DataBytes-PtrSize)/(KeySize+PtrSize);
+  static const SIZE_T LeafSlots = (DataBytes-PtrSize)/(KeySize+ValueSize);
+
+  static char *Keys(char *data, const bool leaf) {
+    return leaf ? data+PtrSize : data;
+  }
+  static char *Vals(char *data) {
+    return data+PtrSize+LeafSlots*KeySize;
+  }
+  static char *Ptrs(char *data) {
+    return data+InteriorSlots*KeySize;
+  }
+
+  // A KeySearchKernel over the keys array
+  static SIZE_T Search(const char *keys, const SIZE_T stride, const SIZE_T numkeys,
+		       const char *key, const bool strict) {
+    SIZE_T lo=0, hi=numkeys;
+    assert(stride==KeySize);
+    while (lo<hi) {
+      SIZE_T mid=lo+(hi-lo)/2;
+      int c=memcmp(keys+mid*KeySize,key,KeySize);
+      if (c<0 || (strict && c==0)) {
+	lo=mid+1;
+      } else {
+	hi=mid;
+      }
+    }
+    return lo;
+  }
+
+  // Move the keys from offset on, with their values or the pointers
+  // after them, up one, in a node with numkeys keys and room for one more
+  static void InsertSlot(char *data, const bool leaf, const SIZE_T numkeys, const SIZE_T offset) {
+    char *keys=Keys(data,leaf);
+    memmove(keys+(offset+1)*KeySize,keys+offset*KeySize,(numkeys-offset)*KeySize);
+    if (leaf) {
+      char *vals=Vals(data);
+      memmove(vals+(offset+1)*ValueSize,vals+offset*ValueSize,(numkeys-offset)*ValueSize);
+    } else {
+      char *ptrs=Ptrs(data);
+      memmove(ptrs+(offset+2)*PtrSize,ptrs+(offset+1)*PtrSize,(numkeys-offset)*PtrSize);
+    }
+  }
+
+  // Move the keys after offset, with their values or pointers, down one
+  static void RemoveSlot(char *data, const bool leaf, const SIZE_T numkeys, const SIZE_T offset) {
+    char *keys=Keys(data,leaf);
+    memmove(keys+offset*KeySize,keys+(offset+1)*KeySize,(numkeys-offset-1)*KeySize);
+    if (leaf) {
+      char *vals=Vals(data);
+      memmove(vals+offset*ValueSize,vals+(offset+1)*ValueSize,(numkeys-offset-1)*ValueSize);
+    } else {
+      char *ptrs=Ptrs(data);
+      memmove(ptrs+(offset+1)*PtrSize,ptrs+(offset+2)*PtrSize,(numkeys-offset-1)*PtrSize);
+    }
+  }
+};
+
+
+//
+// One shape's instantiations
+//
+struct NodeShape {
+  KeySearchKernel search;
+  void (*insertslot)(char *data, const bool leaf, const SIZE_T numkeys, const SIZE_T offset);
+  void (*removeslot)(char *data, const bool leaf, const SIZE_T numkeys, const SIZE_T offset);
+};
+
+// The shape for nodes like info (format, key, value and block sizes),
+// or 0 if it's not one of the instantiated ones and the generic code
+// should be used
+const NodeShape *nodeshape_choose(const NodeMetadata &info);
+
+#endif
@@ -1,3 +1,6 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include "buffercache.h"
 
 ERROR_T BufferCache::CheckDeleteOldest()
@@ -12,15 +15,57 @@ ERROR_T BufferCache::CheckDeleteOldest()
     return ERROR_NOERROR;
   }
 
-  // Find oldest
+  // Find the victim, which can't be pinned
 
-  for (map<SIZE_T, Block, cache_compare_lessthan>::iterator i=blockmap.begin();
+  switch (policy) { 
+  case CACHE_LRU:
+    for (map<SIZE_T, Block, cache_compare_lessthan>::iterator i=blockmap.begin();
+	 i!=blockmap.end();
+	 ++i) {
+      if ((*i).second.pins==0 && (*i).second.lastaccessed<oldest) { 
+	oldestptr=i;
+	oldest=(*i).second.lastaccessed;
+      }
+    }
+    break;
+  case CACHE_MRU:
+    oldest=-1;
+    for (map<SIZE_T, Block, cache_compare_lessthan>::iterator i=blockmap.begin();
 	 i!=blockmap.end();
 	 ++i) {
-       if ((*i).second.lastaccessed<oldest) { 
-	 oldestptr=i;
-	 oldest=(*i).second.lastaccessed;
-       }
+      if ((*i).second.pins==0 && (*i).second.lastaccessed>=oldest) { 
+	oldestptr=i;
+	oldest=(*i).second.lastaccessed;
+      }
+    }
+    break;
+  case CACHE_FIFO:
+    oldest=numloads+1;
+    for (map<SIZE_T, Block, cache_compare_lessthan>::iterator i=blockmap.begin();
+	 i!=blockmap.end();
+	 ++i) {
+      if ((*i).second.pins==0 && (*i).second.loadedat<oldest) { 
+	oldestptr=i;
+	oldest=(*i).second.loadedat;
+      }
+    }
+    break;
+  case CACHE_RANDOM:
+    if (blockmap.size()>0) { 
+      map<SIZE_T, Block, cache_compare_lessthan>::iterator i=blockmap.begin();
+      advance(i,random()%blockmap.size());
+      // the first unpinned block from there on, wrapping around
+      for (SIZE_T n=0;n<blockmap.size();n++) { 
+	if ((*i).second.pins==0) { 
+	  oldestptr=i;
+	  break;
+	}
+	if (++i==blockmap.end()) { 
+	  i=blockmap.begin();
+	}
+      }
+    }
+    break;
   }
   
   // write and delete it if it exists
@@ -43,10 +88,11 @@ ERROR_T BufferCache::CheckDeleteOldest()
 }
 
 BufferCache::BufferCache(DiskSystem *d,
-			 SIZE_T cs) : 
-   disk(d), cachesize(cs), curtime(0),
+			 SIZE_T cs,
+			 const CachePolicy p) : 
+   disk(d), cachesize(cs), policy(p), curtime(0), numloads(0),
    allocs(0), deallocs(0), reads(0), writes(0),
-   diskreads(0), diskwrites(0)
+   diskreads(0), diskwrites(0), trace(0)
 {}
 
 
@@ -66,24 +112,47 @@ ERROR_T BufferCache::Attach()
 
 ERROR_T BufferCache::Detach()
 {
+  double   starttime=curtime;
+  uint64_t start = trace ? Trace::Now() : 0;
+
   // write out all of our data and then throw it away
+  //
+  // Runs of consecutive dirty blocks go to the disk as single
+  // requests, which a striped disk can spread over its members
 
-  for (map<SIZE_T, Block, cache_compare_lessthan>::iterator i=blockmap.begin();
-	 i!=blockmap.end();
-	 ++i) {
-    if ((*i).second.dirty) { 
-      double reqtime;
-      int rc=disk->Write((*i).first,
-			 (*i).second,
-			 reqtime);
-      curtime+=reqtime;
-      diskwrites++;
-      if (rc!=ERROR_NOERROR) { 
-	return rc;
-      }
+  map<SIZE_T, Block, cache_compare_lessthan>::iterator i=blockmap.begin();
+
+  while (i!=blockmap.end()) { 
+    if (!(*i).second.dirty) { 
+      ++i;
+      continue;
+    }
+    SIZE_T start=(*i).first;
+    vector<Block> run;
+    while (i!=blockmap.end() && (*i).second.dirty && (*i).first==start+run.size()) { 
+      run.push_back((*i).second);
+      ++i;
+    }
+    double reqtime;
+    int rc=disk->Write(start,
+		       run.size(),
+		       run,
+		       reqtime);
+    curtime+=reqtime;
+    diskwrites+=run.size();
+    if (rc!=ERROR_NOERROR) { 
+      return rc;
     }
   }
   blockmap.clear();
+  // and make it durable if the disk is set up to
+  int rc=disk->Commit();
+  if (rc!=ERROR_NOERROR) { 
+    return rc;
+  }
+  if (trace) { 
+    trace->Record(TRACE_CACHE_DETACH,0,0,false,curtime-starttime,Trace::Now()-start);
+  }
   return ERROR_NOERROR;
 }
 
@@ -104,11 +173,21 @@ SIZE_T BufferCache::GetNumBlocks() const
   return disk->GetNumBlocks();
 }
 
+ERROR_T BufferCache::Grow(const SIZE_T newblocks)
+{
+  return disk->Grow(newblocks);
+}
+
 double BufferCache::GetCurrentTime() const
 {
   return curtime;
 }
 
+void BufferCache::SetTrace(Trace *t)
+{
+  trace=t;
+}
+
 ERROR_T BufferCache::NotifyAllocateBlock(const SIZE_T outblocknum)
 {
   allocs++;
@@ -131,6 +210,8 @@ bool  BufferCache::IsBlockAllocated(const SIZE_T inblocknum)
 ERROR_T BufferCache::ReadBlock(const SIZE_T inblocknum, Block &outblock) 
 {
   map<SIZE_T, Block, cache_compare_lessthan>::iterator b;
+  double   starttime=curtime;
+  uint64_t start = trace ? Trace::Now() : 0;
 
   b = blockmap.find(inblocknum);
 
@@ -139,6 +220,9 @@ ERROR_T BufferCache::ReadBlock(const SIZE_T inblocknum, Block &outblock)
     outblock=(*b).second;
     (*b).second.lastaccessed=curtime;
     reads++;
+    if (trace) { 
+      trace->Record(TRACE_CACHE_READ,inblocknum,1,true,0,Trace::Now()-start);
+    }
     return ERROR_NOERROR;
   } else {
     // It's not in cache, so time to allocate it
@@ -159,9 +243,13 @@ ERROR_T BufferCache::ReadBlock(const SIZE_T inblocknum, Block &outblock)
       return rc;
     } else {
       outblock.lastaccessed=curtime;
+      outblock.loadedat=numloads++;
       outblock.dirty=false;
       blockmap[inblocknum]=outblock;
       reads++;
+      if (trace) { 
+	trace->Record(TRACE_CACHE_READ,inblocknum,1,false,curtime-starttime,Trace::Now()-start);
+      }
       return ERROR_NOERROR;
     }
   }
@@ -170,15 +258,29 @@ ERROR_T BufferCache::ReadBlock(const SIZE_T inblocknum, Block &outblock)
 ERROR_T BufferCache::WriteBlock(const SIZE_T inblocknum, const Block &inblock)
 {
   map<SIZE_T, Block, cache_compare_lessthan>::iterator b;
+  double   starttime=curtime;
+  uint64_t start = trace ? Trace::Now() : 0;
   
   b = blockmap.find(inblocknum);
 
   if (b!=blockmap.end()) {
-    // It's in  cache, so just replace the block
-    (*b).second=inblock;
+    // It's in  cache, so just replace the contents, in place so that
+    // pinned frames stay where they are
+    if ((*b).second.length==inblock.length) { 
+      memcpy((*b).second.data,inblock.data,inblock.length);
+    } else {
+      double   loadedat=(*b).second.loadedat;
+      unsigned pins=(*b).second.pins;
+      (*b).second=inblock;
+      (*b).second.loadedat=loadedat;
+      (*b).second.pins=pins;
+    }
     (*b).second.lastaccessed=curtime;
     (*b).second.dirty=true;
     writes++;
+    if (trace) { 
+      trace->Record(TRACE_CACHE_WRITE,inblocknum,1,true,0,Trace::Now()-start);
+    }
     return ERROR_NOERROR;
   } else {
     // It's not in cache, so time to allocate it
@@ -190,13 +292,62 @@ ERROR_T BufferCache::WriteBlock(const SIZE_T inblocknum, const Block &inblock)
     }
     Block myblock=inblock;
     myblock.lastaccessed=curtime;
+    myblock.loadedat=numloads++;
     myblock.dirty=true;
     blockmap[inblocknum]=myblock;
     writes++;
+    if (trace) { 
+      trace->Record(TRACE_CACHE_WRITE,inblocknum,1,false,curtime-starttime,Trace::Now()-start);
+    }
     return ERROR_NOERROR;
   }
 }
   
+ERROR_T BufferCache::PinBlock(const SIZE_T inblocknum, const Block *&frame)
+{
+  map<SIZE_T, Block, cache_compare_lessthan>::iterator b;
+
+  b = blockmap.find(inblocknum);
+
+  if (b!=blockmap.end()) {
+    // It's in cache, just update its lastaccessed
+    uint64_t start = trace ? Trace::Now() : 0;
+    (*b).second.lastaccessed=curtime;
+    reads++;
+    if (trace) { 
+      trace->Record(TRACE_CACHE_READ,inblocknum,1,true,0,Trace::Now()-start);
+    }
+  } else {
+    // It's not in cache, so bring it in as a read would
+    Block block;
+    ERROR_T rc=ReadBlock(inblocknum,block);
+    if (rc!=ERROR_NOERROR) { 
+      return rc;
+    }
+    b = blockmap.find(inblocknum);
+  }
+
+  (*b).second.pins++;
+  frame=&((*b).second);
+
+  return ERROR_NOERROR;
+}
+
+ERROR_T BufferCache::UnpinBlock(const SIZE_T inblocknum)
+{
+  map<SIZE_T, Block, cache_compare_lessthan>::iterator b;
+
+  b = blockmap.find(inblocknum);
+
+  if (b==blockmap.end() || (*b).second.pins==0) { 
+    return ERROR_IMPLBUG;
+  }
+
+  (*b).second.pins--;
+
+  return ERROR_NOERROR;
+}
+  
 ERROR_T BufferCache::PrefetchBlock (const SIZE_T blocknum)
 {
   // Not implemented yet
@@ -206,10 +357,15 @@ ERROR_T BufferCache::PrefetchBlock (const SIZE_T blocknum)
 ERROR_T BufferCache::FlushBlock(const SIZE_T blocknum)
 {
   map<SIZE_T, Block, cache_compare_lessthan>::iterator b;
+  double   starttime=curtime;
+  uint64_t start = trace ? Trace::Now() : 0;
   
   b = blockmap.find(blocknum);
 
   if (b==blockmap.end()) { 
+    if (trace) { 
+      trace->Record(TRACE_CACHE_FLUSH,blocknum,1,true,0,Trace::Now()-start);
+    }
     return ERROR_NOERROR;
   } else {
     if ((*b).second.dirty) { 
@@ -224,7 +380,15 @@ ERROR_T BufferCache::FlushBlock(const SIZE_T blocknum)
 	return rc;
       }
     }
-    blockmap.erase(b);
+    if ((*b).second.pins>0) { 
+      // someone is looking at it, so it stays, but it is clean now
+      (*b).second.dirty=false;
+    } else {
+      blockmap.erase(b);
+    }
+    if (trace) { 
+      trace->Record(TRACE_CACHE_FLUSH,blocknum,1,false,curtime-starttime,Trace::Now()-start);
+    }
     return ERROR_NOERROR;
   }
 }
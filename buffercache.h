@@ -7,6 +7,7 @@
 #include "global.h"
 #include "block.h"
 #include "disksystem.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -17,8 +18,17 @@ struct cache_compare_lessthan {
 };
 
 
+// Replacement policies
+enum CachePolicy {
+  CACHE_LRU=0,      // evict the least recently used block
+  CACHE_MRU=1,      // evict the most recently used block
+  CACHE_FIFO=2,     // evict the block that was brought in first
+  CACHE_RANDOM=3    // evict any block
+};
+
 //
 // LRU block cache with single step prefetch
+// (other replacement policies can be selected at construction)
 //
 // Write Back
 // Write Allocate
@@ -26,15 +36,19 @@ class BufferCache {
  private:
   DiskSystem *disk;
   SIZE_T cachesize;
+  CachePolicy policy;
   map<SIZE_T, Block, cache_compare_lessthan> blockmap;
   double curtime;
+  double numloads;
   SIZE_T allocs, deallocs, reads, writes, diskreads, diskwrites;
+  Trace *trace;
  protected:
   ERROR_T CheckDeleteOldest();
  public:
   // Cache size is in number of blocks
   BufferCache(DiskSystem *disk,
-	      const SIZE_T cachesize);
+	      const SIZE_T cachesize,
+	      const CachePolicy policy=CACHE_LRU);
   BufferCache() { throw 0; }
   BufferCache(const BufferCache &rhs) { throw 0; } 
   BufferCache & operator=(const BufferCache &rhs) { throw 0; return *this; } 
@@ -51,9 +65,15 @@ class BufferCache {
   SIZE_T GetBlockSize() const;
   // Number of blocks in the underlying device
   SIZE_T GetNumBlocks() const;
+  // Grow the underlying device (see DiskSystem::Grow)
+  ERROR_T Grow(const SIZE_T newblocks);
   // Current time in the simulation (starts at zero)
   double GetCurrentTime() const;
 
+  // Record every request in the trace (0 to stop)
+  // The disk's own requests are traced via DiskSystem::SetTrace
+  void SetTrace(Trace *trace);
+
   // outblocknum is the number of the block that we just allocated
   // if the error return is nonzero
   ERROR_T NotifyAllocateBlock(const SIZE_T outblocknum);
@@ -71,6 +91,15 @@ class BufferCache {
   // ERROR_WRONGSIZEBLOCK or other nonzero error codes
   ERROR_T WriteBlock(const SIZE_T inblocknum, const Block &inblock);
   
+  // Read a block and hand back the cache's own copy of it, pinned
+  // so that it is not evicted.  Nothing is copied if the block is
+  // cached already.  frame is valid until the matching UnpinBlock, 
+  // and must not be changed.  Pins nest.  If every block is pinned,
+  // the cache holds more than cachesize blocks until some are unpinned.
+  // Unpin everything before Detach.
+  ERROR_T PinBlock(const SIZE_T inblocknum, const Block *&frame);
+  ERROR_T UnpinBlock(const SIZE_T inblocknum);
+
   // Request that a block be read into the cache
   // This returns immediately.
   // ERROR_NOFETCH means that there is no room currently
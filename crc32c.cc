@@ -0,0 +1,100 @@
+#include <string.h>
+
+#include "crc32c.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#endif
+
+#define CRC32C_POLY 0x82f63b78   // reversed Castagnoli polynomial
+
+static uint32_t crc32ctable[8][256];
+
+
+static void crc32c_init_table()
+{
+  for (unsigned i=0;i<256;i++) { 
+    uint32_t c=i;
+    for (int j=0;j<8;j++) { 
+      c = (c & 1) ? (c>>1)^CRC32C_POLY : (c>>1);
+    }
+    crc32ctable[0][i]=c;
+  }
+  for (unsigned i=0;i<256;i++) { 
+    for (int t=1;t<8;t++) { 
+      crc32ctable[t][i] = (crc32ctable[t-1][i]>>8) ^ crc32ctable[0][crc32ctable[t-1][i] & 0xff];
+    }
+  }
+}
+
+// slicing-by-8: eight table lookups per 8 bytes
+static uint32_t crc32c_table(uint32_t crc, const uint8_t *p, size_t len)
+{
+  while (len>=8) { 
+    uint64_t w;
+    memcpy(&w,p,8);
+    w ^= crc;
+    crc = crc32ctable[7][w & 0xff]         ^ crc32ctable[6][(w>>8) & 0xff] ^
+          crc32ctable[5][(w>>16) & 0xff]   ^ crc32ctable[4][(w>>24) & 0xff] ^
+          crc32ctable[3][(w>>32) & 0xff]   ^ crc32ctable[2][(w>>40) & 0xff] ^
+          crc32ctable[1][(w>>48) & 0xff]   ^ crc32ctable[0][w>>56];
+    p+=8;
+    len-=8;
+  }
+  while (len--) { 
+    crc = (crc>>8) ^ crc32ctable[0][(crc ^ *p++) & 0xff];
+  }
+  return crc;
+}
+
+#ifdef CRC32C_HAVE_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, size_t len)
+{
+#ifdef __x86_64__
+  uint64_t c=crc;
+  while (len>=8) { 
+    uint64_t w;
+    memcpy(&w,p,8);
+    c=_mm_crc32_u64(c,w);
+    p+=8;
+    len-=8;
+  }
+  crc=(uint32_t)c;
+#endif
+  while (len>=4) { 
+    uint32_t w;
+    memcpy(&w,p,4);
+    crc=_mm_crc32_u32(crc,w);
+    p+=4;
+    len-=4;
+  }
+  while (len--) { 
+    crc=_mm_crc32_u8(crc,*p++);
+  }
+  return crc;
+}
+#endif
+
+
+typedef uint32_t (*crc32c_fn)(uint32_t, const uint8_t *, size_t);
+
+static crc32c_fn crc32c_choose()
+{
+#ifdef CRC32C_HAVE_SSE42
+  if (__builtin_cpu_supports("sse4.2")) { 
+    return crc32c_sse42;
+  }
+#endif
+  crc32c_init_table();
+  return crc32c_table;
+}
+
+
+uint32_t crc32c(const uint32_t crc, const void *buf, const size_t len)
+{
+  static crc32c_fn fn = crc32c_choose();
+
+  return ~fn(~crc,(const uint8_t *)buf,len);
+}
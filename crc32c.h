@@ -0,0 +1,18 @@
+#ifndef _crc32c
+#define _crc32c
+
+#include <stdint.h>
+#include <stddef.h>
+
+//
+// CRC32C (Castagnoli), as used for the per-block checksums
+//
+// Uses the SSE4.2 crc32 instruction when the CPU has it and a
+// table-driven (slicing-by-8) version otherwise.  The choice is 
+// made once, on first use.
+//
+// crc is the result of a previous call, or 0 to start
+//
+uint32_t crc32c(const uint32_t crc, const void *buf, const size_t len);
+
+#endif
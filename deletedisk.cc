@@ -10,6 +10,15 @@ void usage()
   cerr << "usage: deletedisk filestem\n"; 
 }
 
+static void deletefiles(const string &stem)
+{
+  remove((stem+".data").c_str());
+  remove((stem+".bitmap").c_str());
+  remove((stem+".crc").c_str());
+  remove((stem+".map").c_str());
+  remove((stem+".config").c_str());
+}
+
 int main(int argc, char *argv[])
 {
   if (argc<2) { 
@@ -17,9 +26,18 @@ int main(int argc, char *argv[])
     exit(-1);
   }
 
-  remove((string(argv[1])+".data").c_str());
-  remove((string(argv[1])+".bitmap").c_str());
-  remove((string(argv[1])+".config").c_str());
+  deletefiles(argv[1]);
+
+  // members of a stripe set, if any
+  for (int i=0; ; i++) { 
+    char buf[32];
+    snprintf(buf,32,".%d",i);
+    string stem=string(argv[1])+buf;
+    if (remove((stem+".config").c_str())) { 
+      break;
+    }
+    deletefiles(stem);
+  }
 
   cerr << "Done.\n";
 
@@ -0,0 +1,115 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "deltapack.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define DELTAPACK_HAVE_X86 1
+#endif
+
+//
+// deltapack_search binary searches until at most this many integers
+// are left, then unpacks all of those and counts the ones before v
+//
+#define DELTAPACK_WINDOW 32
+
+typedef void (*DeltaUnpackKernel)(const char *packed, const unsigned bits, const SIZE_T from,
+				  const SIZE_T n, uint64_t *out);
+
+
+static void deltapack_unpack_scalar(const char *packed, const unsigned bits, const SIZE_T from,
+				    const SIZE_T n, uint64_t *out)
+{
+  for (SIZE_T i=0;i<n;i++) {
+    out[i]=deltapack_get(packed,bits,from+i);
+  }
+}
+
+
+#ifdef DELTAPACK_HAVE_X86
+
+//
+// AVX2 gathers the 8 bytes each of 4 integers starts in, and shifts
+// and masks each lane by its own amount.  An integer of more than 57
+// bits can span 9 bytes, so those are unpacked one at a time.
+//
+__attribute__((target("avx2")))
+static void deltapack_unpack_avx2(const char *packed, const unsigned bits, const SIZE_T from,
+				  const SIZE_T n, uint64_t *out)
+{
+  SIZE_T i=0;
+
+  if (bits>0 && bits<=57) {
+    const __m256i mask=_mm256_set1_epi64x((long long)deltapack_mask(bits));
+    const __m256i seven=_mm256_set1_epi64x(7);
+    const __m256i step=_mm256_set1_epi64x(4*(long long)bits);
+    __m256i pos=_mm256_setr_epi64x((long long)(from*bits),(long long)((from+1)*bits),
+				   (long long)((from+2)*bits),(long long)((from+3)*bits));
+    for (;i+4<=n;i+=4) {
+      __m256i v=_mm256_i64gather_epi64((const long long *)packed,_mm256_srli_epi64(pos,3),1);
+      v=_mm256_and_si256(_mm256_srlv_epi64(v,_mm256_and_si256(pos,seven)),mask);
+      _mm256_storeu_si256((__m256i *)(out+i),v);
+      pos=_mm256_add_epi64(pos,step);
+    }
+  }
+  deltapack_unpack_scalar(packed,bits,from+i,n-i,out+i);
+}
+
+#endif
+
+
+static DeltaUnpackKernel deltapack_choose()
+{
+#ifdef DELTAPACK_HAVE_X86
+  if (__builtin_cpu_supports("avx2")) {
+    return deltapack_unpack_avx2;
+  }
+#endif
+  return deltapack_unpack_scalar;
+}
+
+void deltapack_unpack(const char *packed, const unsigned bits, const SIZE_T from,
+		      const SIZE_T n, uint64_t *out)
+{
+  static const DeltaUnpackKernel kernel=deltapack_choose();
+
+  if (bits==0) {
+    memset(out,0,n*sizeof(uint64_t));
+    return;
+  }
+  kernel(packed,bits,from,n,out);
+}
+
+void deltapack_pack(char *packed, const unsigned bits, const SIZE_T from,
+		    const SIZE_T n, const uint64_t *in)
+{
+  for (SIZE_T i=0;i<n;i++) {
+    deltapack_put(packed,bits,from+i,in[i]);
+  }
+}
+
+SIZE_T deltapack_search(const char *packed, const unsigned bits, const SIZE_T n,
+			const uint64_t v, const bool strict)
+{
+  SIZE_T lo=0, hi=n;
+
+  while (hi-lo>DELTAPACK_WINDOW) {
+    SIZE_T mid=lo+(hi-lo)/2;
+    uint64_t m=deltapack_get(packed,bits,mid);
+    if (m<v || (strict && m==v)) {
+      lo=mid+1;
+    } else {
+      hi=mid;
+    }
+  }
+
+  uint64_t window[DELTAPACK_WINDOW];
+  deltapack_unpack(packed,bits,lo,hi-lo,window);
+  for (SIZE_T i=0;i<hi-lo;i++) {
+    if (!(window[i]<v || (strict && window[i]==v))) {
+      return lo+i;
+    }
+  }
+  return hi;
+}
@@ -0,0 +1,109 @@
+#ifndef _deltapack
+#define _deltapack
+
+#include <string.h>
+#include <stdint.h>
+
+#include "global.h"
+
+//
+// Bit packed arrays of unsigned integers
+//
+// The ith integer of an array packed at bits bits each is bits
+// i*bits to (i+1)*bits-1 of the array, counting from the least
+// significant bit of the first byte up, that is, as a little endian
+// bit string.  An array packed at 0 bits is all zeros and takes no
+// room.  They are how BTREE_FORMAT_FOR leaves (see btree_ds.h) keep
+// their keys, as differences from the leaf's least key.
+//
+// The integers are read and written 8 bytes at a time, so up to 8
+// bytes past the end of the array must be there to be read, and are
+// written back as they were.
+//
+
+static inline uint64_t deltapack_load(const char *p)
+{
+  uint64_t w;
+  memcpy(&w,p,sizeof(w));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  w=__builtin_bswap64(w);
+#endif
+  return w;
+}
+
+static inline void deltapack_store(char *p, uint64_t w)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  w=__builtin_bswap64(w);
+#endif
+  memcpy(p,&w,sizeof(w));
+}
+
+static inline uint64_t deltapack_mask(const unsigned bits)
+{
+  return bits>=64 ? ~(uint64_t)0 : ((uint64_t)1<<bits)-1;
+}
+
+// Bits it takes to hold any integer from 0 to max
+static inline unsigned deltapack_bits(const uint64_t max)
+{
+  return max==0 ? 0 : 64-__builtin_clzll(max);
+}
+
+// Bytes an array of n integers packed at bits bits takes
+static inline SIZE_T deltapack_bytes(const unsigned bits, const SIZE_T n)
+{
+  return (n*bits+7)/8;
+}
+
+// The ith integer
+static inline uint64_t deltapack_get(const char *packed, const unsigned bits, const SIZE_T i)
+{
+  if (bits==0) {
+    return 0;
+  }
+  const SIZE_T bit=i*bits;
+  const char *p=packed+bit/8;
+  const unsigned shift=bit%8;
+  uint64_t v=deltapack_load(p)>>shift;
+  if (shift+bits>64) {
+    v|=(uint64_t)(unsigned char)p[8]<<(64-shift);
+  }
+  return v & deltapack_mask(bits);
+}
+
+// Set the ith integer to the low bits bits of v
+static inline void deltapack_put(char *packed, const unsigned bits, const SIZE_T i, const uint64_t v)
+{
+  if (bits==0) {
+    return;
+  }
+  const SIZE_T bit=i*bits;
+  char *p=packed+bit/8;
+  const unsigned shift=bit%8;
+  const uint64_t mask=deltapack_mask(bits);
+  uint64_t w=deltapack_load(p);
+  w=(w & ~(mask<<shift)) | ((v & mask)<<shift);
+  deltapack_store(p,w);
+  if (shift+bits>64) {
+    const unsigned high=shift+bits-64;
+    const unsigned char m=(1u<<high)-1;
+    p[8]=(p[8] & ~m) | ((v>>(64-shift)) & m);
+  }
+}
+
+// Unpack integers from to from+n-1 into out
+void    deltapack_unpack(const char *packed, const unsigned bits, const SIZE_T from,
+			 const SIZE_T n, uint64_t *out);
+// Pack the n integers of in, at bits bits, into integers from on
+void    deltapack_pack(char *packed, const unsigned bits, const SIZE_T from,
+		       const SIZE_T n, const uint64_t *in);
+
+// How many of the n sorted integers of the array are less than v (or,
+// if strict, no greater than v), searched in place.  Like the search
+// kernels of keysearch.h, it binary searches down to a few integers,
+// then unpacks and compares those all at once.
+SIZE_T  deltapack_search(const char *packed, const unsigned bits, const SIZE_T n,
+			 const uint64_t v, const bool strict);
+
+#endif
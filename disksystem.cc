@@ -1,23 +1,29 @@
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <stdint.h>
 
 #include <string.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
 
 #include <math.h>
 
 #include "disksystem.h"
+#include "crc32c.h"
+#include "lzpack.h"
 
 
-static SIZE_T mywrite(FILE *f, const SIZE_T off, const BYTE_T *buf, const int len)
+static SIZE_T mywrite(int fd, const off_t off, const BYTE_T *buf, const int len)
 {
   SIZE_T left=len;
-  SIZE_T sent;
+  ssize_t sent;
 
-  fseek(f,off,SEEK_SET);
   while (left>0) {
-    sent=fwrite(&(buf[len-left]),1,left,f);
+    sent=pwrite(fd,&(buf[len-left]),left,off+(len-left));
     if (sent<0) {	
       return 0;
     } else if (sent==0) {
@@ -29,47 +35,87 @@ static SIZE_T mywrite(FILE *f, const SIZE_T off, const BYTE_T *buf, const int le
   return len-left;
 }
 
-static SIZE_T myread(FILE *f, const SIZE_T off, BYTE_T *buf, const int len, bool trunconeof=true)
+//
+// A block that has never been written may lie beyond the end of 
+// the data file, unless the disk was preallocated.  Such a block
+// reads as zeros, exactly as it would have had the file been extended
+// to cover it, so the short read is filled in rather than retried.
+//
+static SIZE_T myread(int fd, const off_t off, BYTE_T *buf, const int len)
 {
   SIZE_T left=len;
-  SIZE_T sent;
+  ssize_t got;
 
-  fseek(f,off,SEEK_SET);
   while (left>0) {
-    sent=fread(&(buf[len-left]),1,left,f);
-    if (sent<0) {	
+    got=pread(fd,&(buf[len-left]),left,off+(len-left));
+    if (got<0) {	
       return 0;
-    } else if (sent==0) {
-      // if we reached this point, the likely cause is that we
-      // are trying to read a block which has not been allocated yet
-      // Hence, we will try to ftruncate to this size and then retry the
-      // read.  However, we don't want to loop forever doing this,
-      // hence the trunconeof parameter
-      if (!feof(f)) { 
-	// OK, the end of file is not the problem
-	break;
-      } else {
-	// EOF case... should we truncate and try again?
-	if (!trunconeof) { 
-	  break;
-	} else {
-	  // yes!
-	  if (ftruncate(fileno(f),off+len)) { 
-	    // uh oh, something weird is going on
-	    break;
-	  } else {
-	    // OK, now retry, but don't truncate a second time
-	    return myread(f,off,buf,len,false);
-	  }
-	}
-      }
+    } else if (got==0) {
+      // EOF
+      memset(&(buf[len-left]),0,left);
+      left=0;
     } else {
-      left-=sent;
+      left-=got;
     }
   }
   return len-left;
 }
 
+//
+// Reserve the extent [off,off+len) of the data file so that later
+// writes never have to grow it.  Filesystems without fallocate
+// get the (slower) posix_fallocate emulation instead.
+//
+static ERROR_T mypreallocate(int fd, const off_t off, const off_t len)
+{
+  if (fallocate(fd,0,off,len)==0) { 
+    return ERROR_NOERROR;
+  }
+  if (posix_fallocate(fd,off,len)==0) { 
+    return ERROR_NOERROR;
+  }
+  return ERROR_NOSPACE;
+}
+
+
+//
+// filestem.config is a fixed binary header that is read with a single
+// pread when the disk is opened.  Older text configs (version 0.9)
+// are still understood, and are rewritten in binary form when the
+// disk is closed.  Fields are stored at full width regardless of
+// SIZE_T so that the header does not need to change if SIZE_T grows.
+//
+// Version 2 appends the stripe set fields; version 1 headers are
+// plain disks.  Version 3 appends flags; older headers have none.
+//
+#define DISKSYSTEM_CONFIG_MAGIC   0x4b534944   // "DISK"
+#define DISKSYSTEM_CONFIG_VERSION 3
+#define DISKSYSTEM_CONFIG_V1_SIZE offsetof(DiskConfigHeader,nummembers)
+#define DISKSYSTEM_CONFIG_V2_SIZE offsetof(DiskConfigHeader,flags)
+
+// flags
+#define DISKSYSTEM_CONFIG_CHECKSUMS 0x1
+#define DISKSYSTEM_CONFIG_COMPRESS  0x2
+
+struct DiskConfigHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t offset;
+  uint64_t numblocks;
+  uint64_t blocksize;
+  uint64_t numheads;
+  uint64_t blockspertrack;
+  uint64_t numtracks;
+  double   averageseeklatency;
+  double   trackseeklatency;
+  double   rotationallatency;
+  // version 2
+  uint64_t nummembers;
+  uint64_t stripeunit;
+  // version 3
+  uint64_t flags;
+};
+
 
 DiskSystem::DiskSystem(const string &filestem,
 		       const bool   create,
@@ -81,11 +127,21 @@ DiskSystem::DiskSystem(const string &filestem,
 		       const SIZE_T tracks,
 		       const double avgseek,
 		       const double trackseek,
-		       const double rotlat) :
+		       const double rotlat,
+		       const bool   prealloc,
+		       const SIZE_T members,
+		       const SIZE_T unit,
+		       const bool   sums,
+		       const bool   zip) :
   bitmap(0),
-  datafilefd(0),
-  configfilefd(0),
-  bitmapfilefd(0),
+  datafilefd(-1),
+  configfd(-1),
+  bitmapfd(-1),
+  configdirty(false),
+  crctable(0),
+  crcfd(-1),
+  packtable(0),
+  packfd(-1),
   diskfilestem(filestem), 
   offset(offset),
   numblocks(blcks),
@@ -97,11 +153,22 @@ DiskSystem::DiskSystem(const string &filestem,
   last_sector(0),
   averageseeklatency(avgseek),
   trackseeklatency(trackseek),
-  rotationallatency(rotlat)
+  rotationallatency(rotlat),
+  nummembers(members),
+  stripeunit(unit),
+  checksums(sums),
+  compress(zip),
+  trace(0),
+  durability(DURABILITY_NONE),
+  durabilityparam(0),
+  pendingwrites(0),
+  lastsync(0),
+  numsyncs(0),
+  synctime(0)
 {
   if (create) { 
     // Only in this case are the parameters used:
-    InitFromInMemoryConfig();
+    InitFromInMemoryConfig(prealloc);
   } else {
     InitFromConfigFile();
   }
@@ -109,12 +176,21 @@ DiskSystem::DiskSystem(const string &filestem,
 
 DiskSystem::~DiskSystem()
 {
-  WriteConfig();
-  WriteBitMap();
-  fclose(configfilefd);
-  fclose(bitmapfilefd);
-  fclose(datafilefd);
-  delete [] bitmap;
+  Commit();
+  if (configdirty) { 
+    WriteConfig();
+  }
+  UnmapBitMap();
+  UnmapCRCTable();
+  UnmapPackTable();
+  for (SIZE_T i=0;i<members.size();i++) { 
+    delete members[i];
+  }
+  if (configfd>=0) { close(configfd); }
+  if (bitmapfd>=0) { close(bitmapfd); }
+  if (crcfd>=0) { close(crcfd); }
+  if (packfd>=0) { close(packfd); }
+  if (datafilefd>=0) { close(datafilefd); }
 }
 
 ERROR_T DiskSystem::SanityCheckConfig()
@@ -123,10 +199,22 @@ ERROR_T DiskSystem::SanityCheckConfig()
     cerr << "Impossible performance.\n";
     return ERROR_BADCONFIG;
   }
-  if (numblocks != (numheads*blockspertrack*numtracks)) {
+  if (nummembers==0 || stripeunit==0) { 
+    cerr << "Impossible stripe set.\n";
+    return ERROR_BADCONFIG;
+  }
+  if (numblocks != (nummembers*numheads*blockspertrack*numtracks)) {
     cerr << "Geometry mismatch.\n";
     return ERROR_BADCONFIG;
   }
+  if (numblocks==0) { 
+    cerr << "Empty disk.\n";
+    return ERROR_BADCONFIG;
+  }
+  if ((numblocks/nummembers)%stripeunit) { 
+    cerr << "Stripe unit does not divide the member disks.\n";
+    return ERROR_BADCONFIG;
+  }
 
   return ERROR_NOERROR;
 }
@@ -134,30 +222,31 @@ ERROR_T DiskSystem::SanityCheckConfig()
 
 ERROR_T DiskSystem::WriteConfig()
 {
-  ftruncate(fileno(configfilefd),0);
-  rewind(configfilefd);
-  fprintf(configfilefd,"# disksystem config file version 0.9\n");
-  fprintf(configfilefd,"# filestem\n");
-  fprintf(configfilefd,"%s\n",diskfilestem.c_str());
-  fprintf(configfilefd,"# offset\n");
-  fprintf(configfilefd,"%u\n",offset);
-  fprintf(configfilefd,"# numblocks\n");
-  fprintf(configfilefd,"%u\n",numblocks);
-  fprintf(configfilefd,"# blocksize\n");
-  fprintf(configfilefd,"%u\n",blocksize);
-  fprintf(configfilefd,"# numheads\n");
-  fprintf(configfilefd,"%u\n",numheads);
-  fprintf(configfilefd,"# blockspertrack\n");
-  fprintf(configfilefd,"%u\n",blockspertrack);
-  fprintf(configfilefd,"# numtracks\n");
-  fprintf(configfilefd,"%u\n",numtracks);
-  fprintf(configfilefd,"# averageseeklatency\n");
-  fprintf(configfilefd,"%lf\n",averageseeklatency);
-  fprintf(configfilefd,"# trackseeklatency\n");
-  fprintf(configfilefd,"%lf\n",trackseeklatency);
-  fprintf(configfilefd,"# rotationalatency\n");
-  fprintf(configfilefd,"%lf\n",rotationallatency);
-  fflush(configfilefd);
+  DiskConfigHeader h;
+
+  memset(&h,0,sizeof(h));
+  h.magic=DISKSYSTEM_CONFIG_MAGIC;
+  h.version=DISKSYSTEM_CONFIG_VERSION;
+  h.offset=offset;
+  h.numblocks=numblocks;
+  h.blocksize=blocksize;
+  h.numheads=numheads;
+  h.blockspertrack=blockspertrack;
+  h.numtracks=numtracks;
+  h.averageseeklatency=averageseeklatency;
+  h.trackseeklatency=trackseeklatency;
+  h.rotationallatency=rotationallatency;
+  h.nummembers=nummembers;
+  h.stripeunit=stripeunit;
+  h.flags=(checksums ? DISKSYSTEM_CONFIG_CHECKSUMS : 0) | (compress ? DISKSYSTEM_CONFIG_COMPRESS : 0);
+
+  if (pwrite(configfd,&h,sizeof(h),0)!=(ssize_t)sizeof(h) ||
+      ftruncate(configfd,sizeof(h))) { 
+    cerr << "Can't write config file\n";
+    return ERROR_IMPLBUG;
+  }
+
+  configdirty=false;
 
   return ERROR_NOERROR;
 }
@@ -165,11 +254,65 @@ ERROR_T DiskSystem::WriteConfig()
 
 
 ERROR_T DiskSystem::ReadConfig()
+{
+  DiskConfigHeader h;
+  ssize_t n;
+
+  n=pread(configfd,&h,sizeof(h),0);
+
+  if (n>0 && ((char*)&h)[0]=='#') { 
+    // old style text config, rewrite it on close
+    configdirty=true;
+    return ReadTextConfig();
+  }
+
+  if (n<(ssize_t)DISKSYSTEM_CONFIG_V1_SIZE || h.magic!=DISKSYSTEM_CONFIG_MAGIC) { 
+    cerr << "Not a disksystem config file\n";
+    return ERROR_BADCONFIG;
+  }
+
+  if (h.version==1) { 
+    h.nummembers=1;
+    h.stripeunit=1;
+    h.flags=0;
+    configdirty=true;
+  } else if (h.version==2 && n==(ssize_t)DISKSYSTEM_CONFIG_V2_SIZE) { 
+    h.flags=0;
+    configdirty=true;
+  } else if (h.version!=DISKSYSTEM_CONFIG_VERSION || n!=(ssize_t)sizeof(h)) { 
+    cerr << "Unsupported disksystem config version "<<h.version<<endl;
+    return ERROR_BADCONFIG;
+  }
+
+  offset=h.offset;
+  numblocks=h.numblocks;
+  blocksize=h.blocksize;
+  numheads=h.numheads;
+  blockspertrack=h.blockspertrack;
+  numtracks=h.numtracks;
+  averageseeklatency=h.averageseeklatency;
+  trackseeklatency=h.trackseeklatency;
+  rotationallatency=h.rotationallatency;
+  nummembers=h.nummembers;
+  stripeunit=h.stripeunit;
+  checksums=(h.flags & DISKSYSTEM_CONFIG_CHECKSUMS)!=0;
+  compress=(h.flags & DISKSYSTEM_CONFIG_COMPRESS)!=0;
+
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T DiskSystem::ReadTextConfig()
 {
   char buf[80];
+  FILE *configfilefd;
+
+  if ((configfilefd=fdopen(dup(configfd),"r"))==0) { 
+    return ERROR_NOFILE;
+  }
 
 #define GETNEXTVAL do { fgets(buf,80,configfilefd); } while (buf[0]=='#')  
-#define PARSEUNSIGNED(x) do { sscanf(buf,"%u",x); } while (0)
+#define PARSEUNSIGNED(x) do { sscanf(buf,"%llu",x); } while (0)
 #define PARSEDOUBLE(x) do { sscanf(buf,"%lf",x); } while (0)
 
   rewind(configfilefd);
@@ -197,40 +340,451 @@ ERROR_T DiskSystem::ReadConfig()
   GETNEXTVAL;
   PARSEDOUBLE(&rotationallatency);
 
+  nummembers=1;
+  stripeunit=1;
+
+  fclose(configfilefd);
+
   return ERROR_NOERROR;
 }
 
 
-ERROR_T DiskSystem::WriteBitMap()
+SIZE_T DiskSystem::GetNumBitMapBytes() const
 {
-  rewind(bitmapfilefd);
-  
-  SIZE_T numbitmapbytes = numblocks / 8 + (numblocks%8 != 0); 
+  return numblocks / 8 + (numblocks%8 != 0); 
+}
 
-  if (mywrite(bitmapfilefd,0,bitmap,numbitmapbytes)!=numbitmapbytes) { 
-    cerr << "Can't write bitmap file\n";
+//
+// The bitmap is only needed by the allocation sanity checks, so it
+// is not touched until one of them runs.  Opening a disk therefore
+// costs the same no matter how many blocks it has.
+//
+ERROR_T DiskSystem::MapBitMap() const
+{
+  if (bitmap) { 
+    return ERROR_NOERROR;
+  }
+
+  if (bitmapfd<0) { 
+    return ERROR_NOFILE;
+  }
+
+  SIZE_T numbitmapbytes = GetNumBitMapBytes();
+  struct stat s;
+
+  // a short bitmap file would fault when we touched the tail of the map
+  if (fstat(bitmapfd,&s) || 
+      ((SIZE_T)s.st_size<numbitmapbytes && ftruncate(bitmapfd,numbitmapbytes))) { 
+    cerr << "Can't size bitmap file\n";
     return ERROR_IMPLBUG;
   }
+
+  void *m = mmap(0,numbitmapbytes,PROT_READ|PROT_WRITE,MAP_SHARED,bitmapfd,0);
+
+  if (m==MAP_FAILED) { 
+    cerr << "Can't map bitmap file\n";
+    return ERROR_IMPLBUG;
+  }
+
+  bitmap=(BYTE_T*)m;
+
   return ERROR_NOERROR;
 }
 
-ERROR_T DiskSystem::ReadBitMap()
+ERROR_T DiskSystem::UnmapBitMap()
 {
-  rewind(bitmapfilefd);
-  
-  SIZE_T numbitmapbytes = numblocks / 8 + (numblocks%8 != 0); 
+  if (bitmap) { 
+    munmap(bitmap,GetNumBitMapBytes());
+    bitmap=0;
+  }
+  return ERROR_NOERROR;
+}
+
+
+
+//
+// With checksums on, filestem.crc holds the CRC32C of every block,
+// 4 bytes per block, and is mmap'd on the first read or write.
+// It is filled in when the disk is created, so every block, written
+// or not, is checked when it is read.
+//
+ERROR_T DiskSystem::MapCRCTable() const
+{
+  if (crctable) { 
+    return ERROR_NOERROR;
+  }
 
-  if (bitmap) { delete [] bitmap; } ;
+  if (crcfd<0) { 
+    return ERROR_NOFILE;
+  }
 
-  bitmap = new BYTE_T [numbitmapbytes];
+  void *m = mmap(0,numblocks*sizeof(uint32_t),PROT_READ|PROT_WRITE,MAP_SHARED,crcfd,0);
 
-  if (myread(bitmapfilefd,0,bitmap,numbitmapbytes,false)!=numbitmapbytes) { 
-    cerr << "Can't read bitmap file\n";
+  if (m==MAP_FAILED) { 
+    cerr << "Can't map checksum file\n";
     return ERROR_IMPLBUG;
   }
+
+  crctable=(uint32_t*)m;
+
+  return ERROR_NOERROR;
+}
+
+ERROR_T DiskSystem::UnmapCRCTable()
+{
+  if (crctable) { 
+    munmap(crctable,numblocks*sizeof(uint32_t));
+    crctable=0;
+  }
   return ERROR_NOERROR;
 }
 
+// Checksum whatever is in blocks [from,numblocks) of our extent of the 
+// data file now, which is zeros unless we are reusing an existing data 
+// file.  Compressed blocks that haven't been written read as zeros
+// wherever they are.
+ERROR_T DiskSystem::InitCRCTable(const SIZE_T from)
+{
+  UnmapCRCTable();
+
+  if (ftruncate(crcfd,numblocks*sizeof(uint32_t))) { 
+    cerr << "Can't write checksum file\n";
+    return ERROR_IMPLBUG;
+  }
+
+  int rc=MapCRCTable();
+
+  if (rc) { 
+    return rc;
+  }
+
+  Block b(blocksize);
+  struct stat s;
+
+  memset(b.data,0,blocksize);
+  uint32_t zerocrc=crc32c(0,b.data,blocksize);
+
+  if (fstat(datafilefd,&s)) { 
+    return ERROR_IMPLBUG;
+  }
+
+  for (SIZE_T i=from;i<numblocks;i++) { 
+    off_t off=(off_t)offset+(off_t)i*blocksize;
+    if (off>=s.st_size || compress) { 
+      crctable[i]=zerocrc;
+    } else {
+      if (myread(datafilefd,off,b.data,blocksize)!=blocksize) { 
+	return ERROR_IMPLBUG;
+      }
+      crctable[i]=crc32c(0,b.data,blocksize);
+    }
+  }
+
+  return ERROR_NOERROR;
+}
+
+//
+// With compress on, every block is compressed (lzpack) when it is
+// written.  Blocks are taken in groups of DISKSYSTEM_PACK_GROUP, and
+// each group keeps the extent of the data file that its blocks would
+// have had, but packs their compressed images from the front of it,
+// in block order, with a little slack after each so that a block that
+// grows a bit can be rewritten in place.  A block that doesn't fit its
+// slot any more gets the group repacked.
+//
+// filestem.map holds, per block, the byte start of its image in its
+// group's extent and its length.  A length of 0 is a block that has
+// never been written, which reads as zeros, and a length of blocksize
+// is one that didn't compress and is stored as is.  Starts never
+// decrease within a group, so a block's room is up to the next start.
+//
+#define DISKSYSTEM_PACK_GROUP 8
+#define PACK_ENTRY_SIZE       (2*sizeof(uint32_t))
+#define PACK_START(b)         (packtable[2*(b)])
+#define PACK_LENGTH(b)        (packtable[2*(b)+1])
+#define PACK_GROUP_FIRST(b)   ((b)-(b)%DISKSYSTEM_PACK_GROUP)
+
+ERROR_T DiskSystem::MapPackTable() const
+{
+  if (packtable) { 
+    return ERROR_NOERROR;
+  }
+
+  if (packfd<0) { 
+    return ERROR_NOFILE;
+  }
+
+  void *m = mmap(0,numblocks*PACK_ENTRY_SIZE,PROT_READ|PROT_WRITE,MAP_SHARED,packfd,0);
+
+  if (m==MAP_FAILED) { 
+    cerr << "Can't map map file\n";
+    return ERROR_IMPLBUG;
+  }
+
+  packtable=(uint32_t*)m;
+
+  return ERROR_NOERROR;
+}
+
+ERROR_T DiskSystem::UnmapPackTable()
+{
+  if (packtable) { 
+    munmap(packtable,numblocks*PACK_ENTRY_SIZE);
+    packtable=0;
+  }
+  return ERROR_NOERROR;
+}
+
+// Blocks [from,numblocks) have not been written, and start where
+// they would on an uncompressed disk.  A group that was partial
+// before growing has all of its images below that.
+ERROR_T DiskSystem::InitPackTable(const SIZE_T from)
+{
+  UnmapPackTable();
+
+  if (ftruncate(packfd,numblocks*PACK_ENTRY_SIZE)) { 
+    cerr << "Can't write map file\n";
+    return ERROR_IMPLBUG;
+  }
+
+  int rc=MapPackTable();
+
+  if (rc) { 
+    return rc;
+  }
+
+  for (SIZE_T i=from;i<numblocks;i++) { 
+    PACK_START(i)=(i-PACK_GROUP_FIRST(i))*blocksize;
+    PACK_LENGTH(i)=0;
+  }
+
+  return ERROR_NOERROR;
+}
+
+// Bytes that block's image may take without moving anything
+SIZE_T DiskSystem::PackRoom(const SIZE_T block) const
+{
+  SIZE_T first=PACK_GROUP_FIRST(block);
+  SIZE_T end= first+DISKSYSTEM_PACK_GROUP < numblocks ? first+DISKSYSTEM_PACK_GROUP : numblocks;
+
+  if (block+1<end) { 
+    return PACK_START(block+1)-PACK_START(block);
+  } else {
+    return (end-first)*blocksize-PACK_START(block);
+  }
+}
+
+//
+// Lay out the group starting at first again, with images[i] (of 
+// lengths[i] bytes) as the new image of block from+i, and every other
+// block's image carried over.  The group's packed bytes are read and
+// written back whole.
+//
+ERROR_T DiskSystem::Repack(const SIZE_T first,
+			   const SIZE_T from,
+			   const vector<Block> &images,
+			   const vector<SIZE_T> &lengths,
+			   double &reqtime)
+{
+  SIZE_T end= first+DISKSYSTEM_PACK_GROUP < numblocks ? first+DISKSYSTEM_PACK_GROUP : numblocks;
+  off_t  base=(off_t)offset+(off_t)first*blocksize;
+  SIZE_T used=0;
+  bool   keep=false;
+
+  for (SIZE_T b=first;b<end;b++) { 
+    if (PACK_START(b)+PACK_LENGTH(b)>used) { 
+      used=PACK_START(b)+PACK_LENGTH(b);
+    }
+    if ((b<from || b>=from+images.size()) && PACK_LENGTH(b)>0) { 
+      keep=true;
+    }
+  }
+
+  Block oldgroup((end-first)*blocksize);
+  Block newgroup((end-first)*blocksize);
+
+  if (keep) { 
+    if (myread(datafilefd,base,oldgroup.data,used)!=used) { 
+      cerr << "DiskSystem::Write: myread has failed"<<endl;
+      return ERROR_IMPLBUG;
+    }
+    reqtime+=ModelAccess(first,(used+blocksize-1)/blocksize,used);
+  }
+
+  vector<uint32_t> starts, lens;
+  SIZE_T at=0;
+
+  for (SIZE_T b=first;b<end;b++) { 
+    const BYTE_T *image;
+    SIZE_T len;
+    if (b>=from && b<from+images.size()) { 
+      image=images[b-from].data;
+      len=lengths[b-from];
+    } else {
+      image=oldgroup.data+PACK_START(b);
+      len=PACK_LENGTH(b);
+    }
+    memcpy(newgroup.data+at,image,len);
+    starts.push_back(at);
+    lens.push_back(len);
+    if (len>0) { 
+      SIZE_T unit=blocksize/16;
+      SIZE_T slot=((len+len/4+unit-1)/unit)*unit;
+      at+= slot<blocksize ? slot : blocksize;
+    }
+  }
+
+  if (mywrite(datafilefd,base,newgroup.data,at)!=at) { 
+    cerr << "DiskSystem::Write: mywrite has failed"<<endl;
+    return ERROR_IMPLBUG;
+  }
+  reqtime+=ModelAccess(first,(at+blocksize-1)/blocksize,at);
+
+  for (SIZE_T b=first;b<end;b++) { 
+    PACK_START(b)=starts[b-first];
+    PACK_LENGTH(b)=lens[b-first];
+  }
+
+  return ERROR_NOERROR;
+}
+
+ERROR_T DiskSystem::PackedRead(const SIZE_T   inoffblock,
+			       const SIZE_T   numblock,
+			       vector<Block> &blocks,
+			       double        &reqtime)
+{
+  if (MapPackTable()!=ERROR_NOERROR) { 
+    return ERROR_IMPLBUG;
+  }
+
+  // The images of consecutive blocks are in order in the data file
+  SIZE_T last=inoffblock+numblock-1;
+  SIZE_T startbyte=PACK_GROUP_FIRST(inoffblock)*blocksize+PACK_START(inoffblock);
+  SIZE_T endbyte=PACK_GROUP_FIRST(last)*blocksize+PACK_START(last)+PACK_LENGTH(last);
+  SIZE_T numbytes=0;
+
+  for (SIZE_T i=0;i<numblock;i++) { 
+    numbytes+=PACK_LENGTH(inoffblock+i);
+  }
+
+  SIZE_T startblock=startbyte/blocksize;
+  SIZE_T endblock= endbyte>startbyte ? (endbyte+blocksize-1)/blocksize : startblock+1;
+
+  reqtime=ModelAccess(startblock,endblock-startblock,numbytes);
+
+  Block image(blocksize);
+
+  for (SIZE_T i=0;i<numblock;i++) { 
+    SIZE_T b=inoffblock+i;
+    SIZE_T len=PACK_LENGTH(b);
+    off_t  off=(off_t)offset+(off_t)PACK_GROUP_FIRST(b)*blocksize+PACK_START(b);
+    Block  d(blocksize);
+    if (!IsBlockAllocated(b)) { 
+      if (PRINT_DISKSYSTEM_ALLOCATION_ERRORS) {
+	cerr <<"DiskSystem::Read: reading unallocated block "<<b<<endl;
+      }
+    }
+    if (len==0) { 
+      memset(d.data,0,blocksize);
+    } else if (len==blocksize) { 
+      if (myread(datafilefd,off,d.data,blocksize)!=blocksize) { 
+	cerr << "DiskSystem::Read: myread has failed"<<endl;
+	return ERROR_IMPLBUG;
+      }
+    } else {
+      if (myread(datafilefd,off,image.data,len)!=len) { 
+	cerr << "DiskSystem::Read: myread has failed"<<endl;
+	return ERROR_IMPLBUG;
+      }
+      if (!lzpack_decompress(image.data,len,d.data,blocksize)) { 
+	cerr << "DiskSystem::Read: block "<<b<<" does not decompress"<<endl;
+	return checksums ? ERROR_CHECKSUM : ERROR_IMPLBUG;
+      }
+    }
+    if (checksums && crc32c(0,d.data,blocksize)!=crctable[b]) { 
+      cerr << "DiskSystem::Read: checksum mismatch on block "<<b<<endl;
+      return ERROR_CHECKSUM;
+    }
+    blocks.push_back(d);
+  }
+
+  return ERROR_NOERROR;
+}
+
+ERROR_T DiskSystem::PackedWrite(const SIZE_T   inoffblock,
+				const SIZE_T   numblock,
+				const vector<Block> &blocks,
+				double        &reqtime)
+{
+  if (MapPackTable()!=ERROR_NOERROR) { 
+    return ERROR_IMPLBUG;
+  }
+
+  SIZE_T end=inoffblock+numblock;
+
+  // One group at a time
+  for (SIZE_T from=inoffblock;from<end;) { 
+    SIZE_T to=PACK_GROUP_FIRST(from)+DISKSYSTEM_PACK_GROUP;
+    if (to>end) { 
+      to=end;
+    }
+
+    vector<Block>  images;
+    vector<SIZE_T> lengths;
+    bool fits=true;
+    SIZE_T numbytes=0;
+
+    for (SIZE_T b=from;b<to;b++) { 
+      const Block &d=blocks[b-inoffblock];
+      if (!IsBlockAllocated(b)) { 
+	if (PRINT_DISKSYSTEM_ALLOCATION_ERRORS) {
+	  cerr <<"DiskSystem::Write: writing unallocated block "<<b<<endl;
+	}
+      }
+      images.push_back(Block(blocksize));
+      SIZE_T len=lzpack_compress(d.data,blocksize,images.back().data,blocksize-1);
+      if (len==0) { 
+	// doesn't compress
+	memcpy(images.back().data,d.data,blocksize);
+	len=blocksize;
+      }
+      lengths.push_back(len);
+      numbytes+=len;
+      if (len>PackRoom(b)) { 
+	fits=false;
+      }
+    }
+
+    if (fits) { 
+      SIZE_T startblock=PACK_GROUP_FIRST(from)+PACK_START(from)/blocksize;
+      SIZE_T endblock=PACK_GROUP_FIRST(from)+(PACK_START(to-1)+lengths.back()+blocksize-1)/blocksize;
+      reqtime+=ModelAccess(startblock,endblock>startblock ? endblock-startblock : 1,numbytes);
+      for (SIZE_T b=from;b<to;b++) { 
+	off_t off=(off_t)offset+(off_t)PACK_GROUP_FIRST(b)*blocksize+PACK_START(b);
+	if (mywrite(datafilefd,off,images[b-from].data,lengths[b-from])!=lengths[b-from]) {  
+	  cerr << "DiskSystem::Write: mywrite has failed"<<endl;
+	  return ERROR_IMPLBUG;
+	}
+	PACK_LENGTH(b)=lengths[b-from];
+      }
+    } else {
+      ERROR_T rc=Repack(PACK_GROUP_FIRST(from),from,images,lengths,reqtime);
+      if (rc) { 
+	return rc;
+      }
+    }
+
+    if (checksums) { 
+      for (SIZE_T b=from;b<to;b++) { 
+	crctable[b]=crc32c(0,blocks[b-inoffblock].data,blocksize);
+      }
+    }
+
+    from=to;
+  }
+
+  return ERROR_NOERROR;
+}
 
 
 ERROR_T DiskSystem::InitFromConfigFile()
@@ -238,10 +792,12 @@ ERROR_T DiskSystem::InitFromConfigFile()
   string configname = diskfilestem + ".config";
   string dataname = diskfilestem + ".data";
   string bitmapname = diskfilestem + ".bitmap";
+  string crcname = diskfilestem + ".crc";
+  string packname = diskfilestem + ".map";
   
-  if (configfilefd) { fclose(configfilefd); }
+  if (configfd>=0) { close(configfd); }
   
-  if ((configfilefd = fopen(configname.c_str(),"r+"))==0) { 
+  if ((configfd = open(configname.c_str(),O_RDWR))<0) { 
     return ERROR_NOFILE;
   }
 
@@ -257,34 +813,51 @@ ERROR_T DiskSystem::InitFromConfigFile()
     return rc;
   }
 
-  if (datafilefd) { fclose(datafilefd);}
+  if (IsStriped()) { 
+    // we have no data or bitmap of our own
+    return OpenMembers();
+  }
+
+  if (datafilefd>=0) { close(datafilefd);}
 
-  if ((datafilefd = fopen(dataname.c_str(),"r+"))==0) { 
+  if ((datafilefd = open(dataname.c_str(),O_RDWR))<0) { 
     return ERROR_NOFILE;
   }
 
 
-  if (bitmapfilefd) { fclose(bitmapfilefd);}
+  if (bitmapfd>=0) { close(bitmapfd);}
 
-  if ((bitmapfilefd = fopen(bitmapname.c_str(),"r+"))==0) { 
+  if ((bitmapfd = open(bitmapname.c_str(),O_RDWR))<0) { 
     return ERROR_NOFILE;
   }
-  
-  rc = ReadBitMap();
 
-  if (rc) { 
-    return rc;
+  if (checksums) { 
+    if (crcfd>=0) { close(crcfd);}
+
+    if ((crcfd = open(crcname.c_str(),O_RDWR))<0) { 
+      return ERROR_NOFILE;
+    }
   }
 
+  if (compress) { 
+    if (packfd>=0) { close(packfd);}
+
+    if ((packfd = open(packname.c_str(),O_RDWR))<0) { 
+      return ERROR_NOFILE;
+    }
+  }
+  
   return ERROR_NOERROR;
 }
 
 
-ERROR_T DiskSystem::InitFromInMemoryConfig()
+ERROR_T DiskSystem::InitFromInMemoryConfig(const bool prealloc)
 {
   string configname = diskfilestem + ".config";
   string dataname = diskfilestem + ".data";
   string bitmapname = diskfilestem + ".bitmap";
+  string crcname = diskfilestem + ".crc";
+  string packname = diskfilestem + ".map";
 
   int rc=SanityCheckConfig();
 
@@ -309,9 +882,9 @@ ERROR_T DiskSystem::InitFromInMemoryConfig()
 
 
   // config
-  if (configfilefd) { fclose(configfilefd); }
+  if (configfd>=0) { close(configfd); }
   
-  if ((configfilefd = fopen(configname.c_str(),"w+"))==0) { 
+  if ((configfd = open(configname.c_str(),O_RDWR|O_CREAT|O_TRUNC,0666))<0) { 
     return ERROR_NOFILE;
   }
 
@@ -321,45 +894,72 @@ ERROR_T DiskSystem::InitFromInMemoryConfig()
     return rc;
   }
 
+  if (IsStriped()) { 
+    // we have no data or bitmap of our own
+    return CreateMembers(prealloc);
+  }
 
-  // allocate in-memory bitmap
-
-  SIZE_T numbitmapbytes = numblocks / 8 + (numblocks%8 != 0); 
-  
-  bitmap = new BYTE_T [numbitmapbytes];
-
-  memset(bitmap,0,numbitmapbytes);
 
-  // create the bitmap file and write out the bitmap
+  // create the bitmap file, all blocks free
+  // the file is extended, not written, so it is sparse
 
-  if (bitmapfilefd) { fclose(bitmapfilefd); }
+  if (bitmapfd>=0) { close(bitmapfd); }
 
-  if ((bitmapfilefd = fopen(bitmapname.c_str(),"w+"))==0) { 
+  if ((bitmapfd = open(bitmapname.c_str(),O_RDWR|O_CREAT|O_TRUNC,0666))<0) { 
     return ERROR_NOFILE;
   }
 
-  rc = WriteBitMap();
-  
-  if (rc) { 
-    return rc;
+  if (ftruncate(bitmapfd,GetNumBitMapBytes())) { 
+    cerr << "Can't write bitmap file\n";
+    return ERROR_IMPLBUG;
   }
 
   // Now we'll open the data file
   // notice that we will REUSE an existing data file if it exists
   // The idea is that we will write only from offset to offset+blocksize*numblocks
 
-  if (datafilefd) { fclose(datafilefd);}
+  if (datafilefd>=0) { close(datafilefd);}
 
-  if (stat(dataname.c_str(),&s)!=-1) { 
-    // reuse existing datafile
-    if ((datafilefd = fopen(dataname.c_str(),"r+"))==0) { 
+  if ((datafilefd = open(dataname.c_str(),O_RDWR|O_CREAT,0666))<0) { 
+    return ERROR_NOFILE;
+  }
+
+  // Optionally reserve our whole extent now so that the first touch
+  // of a block costs the same as any other
+  if (prealloc) { 
+    rc = mypreallocate(datafilefd,(off_t)offset,(off_t)numblocks*blocksize);
+    if (rc) { 
+      cerr << "Can't preallocate data file\n";
+      return rc;
+    }
+  }
+
+  if (checksums) { 
+    if (crcfd>=0) { close(crcfd); }
+
+    if ((crcfd = open(crcname.c_str(),O_RDWR|O_CREAT|O_TRUNC,0666))<0) { 
       return ERROR_NOFILE;
     }
-  } else {
-    // create new data file
-    if ((datafilefd = fopen(dataname.c_str(),"w+"))==0) { 
+
+    rc = InitCRCTable(0);
+
+    if (rc) { 
+      return rc;
+    }
+  }
+
+  if (compress) { 
+    if (packfd>=0) { close(packfd); }
+
+    if ((packfd = open(packname.c_str(),O_RDWR|O_CREAT|O_TRUNC,0666))<0) { 
       return ERROR_NOFILE;
     }
+
+    rc = InitPackTable(0);
+
+    if (rc) { 
+      return rc;
+    }
   }
 
   return ERROR_NOERROR;
@@ -369,11 +969,174 @@ ERROR_T DiskSystem::InitFromInMemoryConfig()
 
     
 
+static string MemberStem(const string &filestem, const SIZE_T i)
+{
+  char buf[32];
+  snprintf(buf,32,".%llu",i);
+  return filestem+buf;
+}
+
+ERROR_T DiskSystem::CreateMembers(const bool prealloc)
+{
+  for (SIZE_T i=0;i<nummembers;i++) { 
+    DiskSystem *d = new DiskSystem(MemberStem(diskfilestem,i),
+				   true,
+				   offset,
+				   numblocks/nummembers,
+				   blocksize,
+				   numheads,
+				   blockspertrack,
+				   numtracks,
+				   averageseeklatency,
+				   trackseeklatency,
+				   rotationallatency,
+				   prealloc,
+				   1,
+				   1,
+				   checksums,
+				   compress);
+    members.push_back(d);
+    if (d->configfd<0 || d->datafilefd<0) { 
+      cerr << "Can't create member disk "<<i<<endl;
+      return ERROR_NOFILE;
+    }
+  }
+  return ERROR_NOERROR;
+}
+
+ERROR_T DiskSystem::OpenMembers()
+{
+  for (SIZE_T i=0;i<nummembers;i++) { 
+    DiskSystem *d = new DiskSystem(MemberStem(diskfilestem,i));
+    members.push_back(d);
+    if (d->datafilefd<0 || 
+	d->numblocks!=numblocks/nummembers || 
+	d->blocksize!=blocksize) { 
+      cerr << "Member disk "<<i<<" is missing or does not match the stripe set\n";
+      return ERROR_BADCONFIG;
+    }
+  }
+  return ERROR_NOERROR;
+}
+
+
+void DiskSystem::MapStripedBlock(const SIZE_T block, SIZE_T &member, SIZE_T &memberblock) const
+{
+  SIZE_T stripe = block / stripeunit;
+
+  member = stripe % nummembers;
+  memberblock = (stripe / nummembers)*stripeunit + block % stripeunit;
+}
+
+
+//
+// One member's share of a striped request.  A member's share of
+// any contiguous range of blocks is itself contiguous on the member.
+//
+struct StripeRequest {
+  DiskSystem    *disk;
+  bool           write;
+  SIZE_T         offblock;
+  SIZE_T         numblock;
+  vector<Block>  blocks;
+  double         reqtime;
+  ERROR_T        rc;
+};
+
+static void *DoStripeRequest(void *arg)
+{
+  StripeRequest *r = (StripeRequest *) arg;
+
+  if (r->write) { 
+    r->rc = r->disk->Write(r->offblock,r->numblock,r->blocks,r->reqtime);
+  } else {
+    r->rc = r->disk->Read(r->offblock,r->numblock,r->blocks,r->reqtime);
+  }
+  return 0;
+}
+
+ERROR_T DiskSystem::StripedAccess(const bool           write,
+				  const SIZE_T         inoffblock,
+				  const SIZE_T         numblock,
+				  const vector<Block> &inblocks,
+				  vector<Block>       &outblocks,
+				  double              &reqtime)
+{
+  vector<StripeRequest> reqs(nummembers);
+  vector<SIZE_T> active;
+  SIZE_T m, mb;
+
+  for (m=0;m<nummembers;m++) { 
+    reqs[m].disk=members[m];
+    reqs[m].write=write;
+    reqs[m].numblock=0;
+    reqs[m].reqtime=0;
+    reqs[m].rc=ERROR_NOERROR;
+  }
+
+  // split the request among the members
+  for (SIZE_T i=0;i<numblock;i++) { 
+    MapStripedBlock(inoffblock+i,m,mb);
+    if (reqs[m].numblock==0) { 
+      reqs[m].offblock=mb;
+      active.push_back(m);
+    }
+    reqs[m].numblock++;
+    if (write) { 
+      reqs[m].blocks.push_back(inblocks[i]);
+    }
+  }
+
+  // members work concurrently; we take the last share ourselves
+  vector<pthread_t> threads(active.size());
+  vector<bool> started(active.size(),false);
+
+  for (SIZE_T i=0;i+1<active.size();i++) { 
+    started[i] = pthread_create(&threads[i],0,DoStripeRequest,&reqs[active[i]])==0;
+    if (!started[i]) { 
+      DoStripeRequest(&reqs[active[i]]);
+    }
+  }
+  if (active.size()>0) { 
+    DoStripeRequest(&reqs[active.back()]);
+  }
+  for (SIZE_T i=0;i+1<active.size();i++) { 
+    if (started[i]) { 
+      pthread_join(threads[i],0);
+    }
+  }
+
+  // the request finishes when its slowest member does
+  reqtime=0;
+  for (SIZE_T i=0;i<active.size();i++) { 
+    StripeRequest &r = reqs[active[i]];
+    if (r.rc!=ERROR_NOERROR) { 
+      return r.rc;
+    }
+    if (r.reqtime>reqtime) { 
+      reqtime=r.reqtime;
+    }
+  }
+
+  // reassemble reads in the order they were asked for
+  if (!write) { 
+    vector<SIZE_T> next(nummembers,0);
+    for (SIZE_T i=0;i<numblock;i++) { 
+      MapStripedBlock(inoffblock+i,m,mb);
+      outblocks.push_back(reqs[m].blocks[next[m]++]);
+    }
+  }
+
+  return ERROR_NOERROR;
+}
+
+    
+
 //
 // Note, this assumes disk is kept continously busy
 // or that time does not advance except during a disk op
 //
-double DiskSystem::ModelAccess(const SIZE_T offblock, const SIZE_T numblock) 
+double DiskSystem::ModelAccess(const SIZE_T offblock, const SIZE_T numblock, const SIZE_T numbytes) 
 {
 
   SIZE_T req_trackstart = (offblock) / (numheads*blockspertrack);
@@ -403,8 +1166,10 @@ double DiskSystem::ModelAccess(const SIZE_T offblock, const SIZE_T numblock)
   SIZE_T numtrackbytrackhops = req_trackend-req_trackstart;
   double timeintrackbytrackhops = numtrackbytrackhops*trackseeklatency;
 
-  // The total number of sectors read
-  double timeinreadsectors = rotationallatency*((double)numblock/(double)blockspertrack);
+  // The total number of sectors read, or of the bytes actually
+  // transferred when they are fewer (compressed blocks)
+  double numsectors = numbytes ? (double)numbytes/(double)blocksize : (double)numblock;
+  double timeinreadsectors = rotationallatency*(numsectors/(double)blockspertrack);
 
   last_track=req_trackend;
   last_sector=req_sectorend;
@@ -417,6 +1182,181 @@ ERROR_T DiskSystem::Read(const SIZE_T   inoffblock,
 			 const SIZE_T   numblock,
 			 vector<Block> &blocks,
 			 double        &reqtime)
+{
+  uint64_t start = trace ? Trace::Now() : 0;
+
+  ERROR_T rc = DoRead(inoffblock,numblock,blocks,reqtime);
+
+  if (trace && rc==ERROR_NOERROR) { 
+    trace->Record(TRACE_DISK_READ,inoffblock,numblock,false,reqtime,Trace::Now()-start);
+  }
+
+  return rc;
+}
+
+ERROR_T DiskSystem::Write(const SIZE_T   inoffblock,
+			  const SIZE_T   numblock,
+			  const vector<Block> &blocks,
+			  double        &reqtime)
+{
+  uint64_t start = trace ? Trace::Now() : 0;
+
+  ERROR_T rc = DoWrite(inoffblock,numblock,blocks,reqtime);
+
+  if (trace && rc==ERROR_NOERROR) { 
+    trace->Record(TRACE_DISK_WRITE,inoffblock,numblock,false,reqtime,Trace::Now()-start);
+  }
+
+  if (rc!=ERROR_NOERROR) { 
+    return rc;
+  }
+
+  pendingwrites++;
+
+  switch (durability) { 
+  case DURABILITY_EVERYN:
+    if (pendingwrites>=durabilityparam) { 
+      rc=Sync();
+    }
+    break;
+  case DURABILITY_GROUP:
+    if ((Trace::Now()-lastsync)/1e6>=durabilityparam) { 
+      rc=Sync();
+    }
+    break;
+  default:
+    break;
+  }
+
+  return rc;
+}
+
+
+//
+// The disk grows by whole cylinders (heads*blockspertrack blocks), 
+// that is, by adding tracks, so it may grow by more than was asked.
+// Nothing already on the disk moves.  The data file is not touched,
+// since blocks past its end read as zeros, so the cost is that of 
+// extending the bitmap and checksums, in proportion to the growth.
+//
+ERROR_T DiskSystem::Grow(const SIZE_T newblocks)
+{
+  ERROR_T rc;
+  SIZE_T  cylinder=numheads*blockspertrack;
+
+  if (newblocks==0) { 
+    return ERROR_NOERROR;
+  }
+
+  if (IsStriped()) { 
+    // Every member grows by the same whole number of cylinders that
+    // is also a whole number of stripe units, so the stripes that
+    // exist keep their places and the new ones follow them
+    SIZE_T unit=cylinder;
+    while (unit%stripeunit) { 
+      unit+=cylinder;
+    }
+    SIZE_T permember=(newblocks+nummembers-1)/nummembers;
+    permember=((permember+unit-1)/unit)*unit;
+
+    for (SIZE_T i=0;i<members.size();i++) { 
+      if ((rc=members[i]->Grow(permember))!=ERROR_NOERROR) { 
+	return rc;
+      }
+    }
+    numtracks+=permember/cylinder;
+    numblocks=nummembers*numheads*blockspertrack*numtracks;
+    return WriteConfig();
+  }
+
+  SIZE_T oldblocks=numblocks;
+
+  // the maps are sized by numblocks
+  UnmapBitMap();
+  UnmapCRCTable();
+  UnmapPackTable();
+
+  numtracks+=(newblocks+cylinder-1)/cylinder;
+  numblocks=numheads*blockspertrack*numtracks;
+
+  // the new blocks are free
+  if (ftruncate(bitmapfd,GetNumBitMapBytes())) { 
+    cerr << "Can't grow bitmap file\n";
+    return ERROR_IMPLBUG;
+  }
+
+  if (checksums && (rc=InitCRCTable(oldblocks))!=ERROR_NOERROR) { 
+    cerr << "Can't grow checksum file\n";
+    return rc;
+  }
+
+  if (compress && (rc=InitPackTable(oldblocks))!=ERROR_NOERROR) { 
+    cerr << "Can't grow map file\n";
+    return rc;
+  }
+
+  return WriteConfig();
+}
+
+
+void DiskSystem::SetDurability(const DurabilityMode mode, const double param)
+{
+  durability=mode;
+  durabilityparam=param;
+  lastsync=Trace::Now();
+}
+
+ERROR_T DiskSystem::Commit()
+{
+  if (durability==DURABILITY_NONE || pendingwrites==0) { 
+    return ERROR_NOERROR;
+  }
+  return Sync();
+}
+
+ERROR_T DiskSystem::Sync()
+{
+  uint64_t start=Trace::Now();
+  ERROR_T  rc=ERROR_NOERROR;
+
+  if (IsStriped()) { 
+    for (SIZE_T i=0;i<members.size();i++) { 
+      if (members[i]->Sync()!=ERROR_NOERROR) { 
+	rc=ERROR_IMPLBUG;
+      }
+    }
+  } else {
+    if (fdatasync(datafilefd)) { 
+      rc=ERROR_IMPLBUG;
+    }
+    if (bitmap && msync(bitmap,GetNumBitMapBytes(),MS_SYNC)) { 
+      rc=ERROR_IMPLBUG;
+    }
+    if (crctable && msync(crctable,numblocks*sizeof(uint32_t),MS_SYNC)) { 
+      rc=ERROR_IMPLBUG;
+    }
+    if (packtable && msync(packtable,numblocks*PACK_ENTRY_SIZE,MS_SYNC)) { 
+      rc=ERROR_IMPLBUG;
+    }
+  }
+
+  lastsync=Trace::Now();
+  pendingwrites=0;
+  numsyncs++;
+  synctime+=(lastsync-start)/1e6;
+
+  if (trace) { 
+    trace->Record(TRACE_DISK_SYNC,0,0,false,0,lastsync-start);
+  }
+
+  return rc;
+}
+
+
+ERROR_T DiskSystem::DoRead(const SIZE_T   inoffblock,
+			   const SIZE_T   numblock,
+			   vector<Block> &blocks,
+			   double        &reqtime)
 {
   reqtime=0;
 
@@ -425,6 +1365,18 @@ ERROR_T DiskSystem::Read(const SIZE_T   inoffblock,
     return ERROR_NOSPACE;
   }
 
+  if (IsStriped()) { 
+    return StripedAccess(false,inoffblock,numblock,blocks,blocks,reqtime);
+  }
+
+  if (checksums && MapCRCTable()!=ERROR_NOERROR) { 
+    return ERROR_IMPLBUG;
+  }
+
+  if (compress) { 
+    return PackedRead(inoffblock,numblock,blocks,reqtime);
+  }
+
   reqtime=ModelAccess(inoffblock,numblock);
 
   for (SIZE_T i=0;i<numblock;i++) { 
@@ -434,20 +1386,24 @@ ERROR_T DiskSystem::Read(const SIZE_T   inoffblock,
 	cerr <<"DiskSystem::Read: reading unallocated block "<<(i+inoffblock)<<endl;
       }
     }
-    if (myread(datafilefd,offset+(inoffblock+i)*blocksize,b.data,blocksize,true)!=blocksize) { 
+    if (myread(datafilefd,(off_t)offset+(off_t)(inoffblock+i)*blocksize,b.data,blocksize)!=blocksize) { 
       cerr << "DiskSystem::Read: myread has failed"<<endl;
       return ERROR_IMPLBUG;
     }
+    if (checksums && crc32c(0,b.data,blocksize)!=crctable[inoffblock+i]) { 
+      cerr << "DiskSystem::Read: checksum mismatch on block "<<(inoffblock+i)<<endl;
+      return ERROR_CHECKSUM;
+    }
     blocks.push_back(b);
   }
 
   return ERROR_NOERROR;
 }
 
-ERROR_T DiskSystem::Write(const SIZE_T   inoffblock,
-			  const SIZE_T   numblock,
-			  const vector<Block> &blocks,
-			  double        &reqtime)
+ERROR_T DiskSystem::DoWrite(const SIZE_T   inoffblock,
+			    const SIZE_T   numblock,
+			    const vector<Block> &blocks,
+			    double        &reqtime)
 {
   reqtime=0;
 
@@ -456,6 +1412,19 @@ ERROR_T DiskSystem::Write(const SIZE_T   inoffblock,
     return ERROR_NOSPACE;
   }
 
+  if (IsStriped()) { 
+    vector<Block> unused;
+    return StripedAccess(true,inoffblock,numblock,blocks,unused,reqtime);
+  }
+
+  if (checksums && MapCRCTable()!=ERROR_NOERROR) { 
+    return ERROR_IMPLBUG;
+  }
+
+  if (compress) { 
+    return PackedWrite(inoffblock,numblock,blocks,reqtime);
+  }
+
   reqtime=ModelAccess(inoffblock,numblock);
 
   for (SIZE_T i=0;i<numblock;i++) { 
@@ -464,10 +1433,13 @@ ERROR_T DiskSystem::Write(const SIZE_T   inoffblock,
 	cerr <<"DiskSystem::Write: writing unallocated block "<<(i+inoffblock)<<endl;
       }
     }
-    if (mywrite(datafilefd,offset+(inoffblock+i)*blocksize,blocks[i].data,blocksize)!=blocksize) {  
+    if (mywrite(datafilefd,(off_t)offset+(off_t)(inoffblock+i)*blocksize,blocks[i].data,blocksize)!=blocksize) {  
       cerr << "DiskSystem::Write: mywrite has failed"<<endl;
       return ERROR_IMPLBUG;
     }
+    if (checksums) { 
+      crctable[inoffblock+i]=crc32c(0,blocks[i].data,blocksize);
+    }
   }
 
   return ERROR_NOERROR;
@@ -505,6 +1477,12 @@ ERROR_T DiskSystem::Write(const SIZE_T inoffblock, const Block &blocks, double &
 }
 
 
+void DiskSystem::SetTrace(Trace *t)
+{
+  trace=t;
+}
+
+
 SIZE_T DiskSystem::GetBlockSize() const
 {
   return blocksize;
@@ -524,6 +1502,14 @@ SIZE_T DiskSystem::GetNumBlocks() const
 
 bool DiskSystem::IsBlockAllocated(const SIZE_T block)
 {
+  if (IsStriped()) { 
+    SIZE_T m, mb;
+    MapStripedBlock(block,m,mb);
+    return members[m]->IsBlockAllocated(mb);
+  }
+  if (MapBitMap()!=ERROR_NOERROR) { 
+    return false;
+  }
   return GETBIT(block);
 }
 
@@ -535,6 +1521,23 @@ ERROR_T DiskSystem::NotifyAllocateBlocks(const SIZE_T offset, const SIZE_T innum
     return ERROR_NOSUCHBLOCK;
   }
 
+  if (IsStriped()) { 
+    for (SIZE_T i=offset; i<(offset+innumblocks); i++) { 
+      SIZE_T m, mb;
+      MapStripedBlock(i,m,mb);
+      ERROR_T rc=members[m]->NotifyAllocateBlocks(mb,1);
+      if (rc) { 
+	return rc;
+      }
+    }
+    return ERROR_NOERROR;
+  }
+
+  ERROR_T rc=MapBitMap();
+
+  if (rc) { 
+    return rc;
+  }
 
   for (SIZE_T i=offset; i<(offset+innumblocks); i++) { 
     if (IsBlockAllocated(i)) {
@@ -555,6 +1558,23 @@ ERROR_T DiskSystem::NotifyDeallocateBlocks(const SIZE_T offset,const SIZE_T innu
     return ERROR_NOSUCHBLOCK;
   }
 
+  if (IsStriped()) { 
+    for (SIZE_T i=offset; i<(offset+innumblocks); i++) { 
+      SIZE_T m, mb;
+      MapStripedBlock(i,m,mb);
+      ERROR_T rc=members[m]->NotifyDeallocateBlocks(mb,1);
+      if (rc) { 
+	return rc;
+      }
+    }
+    return ERROR_NOERROR;
+  }
+
+  ERROR_T rc=MapBitMap();
+
+  if (rc) { 
+    return rc;
+  }
 
   for (SIZE_T i=offset; i<(offset+innumblocks); i++) { 
     if (!IsBlockAllocated(i)) {
@@ -583,13 +1603,32 @@ ostream & DiskSystem::Print(ostream &os) const
      << ", averageseeklatency="<<averageseeklatency
      << ", trackseeklatency="<<trackseeklatency
      << ", rotationallatency="<<rotationallatency
-     << ", bitmap=";
+     << ", checksums="<<checksums
+     << ", compress="<<compress;
+
+  if (IsStriped()) { 
+    os << ", nummembers="<<nummembers
+       << ", stripeunit="<<stripeunit
+       << ", members={";
+    for (SIZE_T i=0;i<members.size();i++) { 
+      if (i>0) { 
+	os << ", ";
+      }
+      os << *(members[i]);
+    }
+    os << "})";
+    return os;
+  }
 
-  for (SIZE_T i=0;i<numblocks;i++) { 
-    if (GETBIT(i)) { 
-      os <<"*";
-    } else {
-      os <<".";
+  os << ", bitmap=";
+
+  if (MapBitMap()==ERROR_NOERROR) { 
+    for (SIZE_T i=0;i<numblocks;i++) { 
+      if (GETBIT(i)) { 
+	os <<"*";
+      } else {
+	os <<".";
+      }
     }
   }
 
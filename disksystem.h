@@ -4,23 +4,50 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <stdint.h>
 
 #include "global.h"
 #include "block.h"
+#include "trace.h"
 
 using namespace std;
 
+// When writes are forced to stable storage (fdatasync)
+enum DurabilityMode {
+  DURABILITY_NONE=0,    // never, the OS writes back when it likes
+  DURABILITY_DETACH=1,  // on Commit (BufferCache::Detach) and close
+  DURABILITY_EVERYN=2,  // after every N write requests, and as DETACH
+  DURABILITY_GROUP=3    // the first write request at least N ms after 
+                        // the last sync syncs for everything since,
+                        // and as DETACH
+};
+
 // Models a single disk with a single outstanding request
 //
 // Includes storage allocator and free space bitmap to 
 // simplify project - REAL DISKS DO NOT HAVE ALLOCATORS OR BITMAPS
 //
+// A DiskSystem can also be a stripe set (RAID-0) over several member
+// DiskSystems.  Block b lives in stripe b/stripeunit, and stripe s
+// lives on member s%nummembers.  Each member is a complete disk
+// with its own files and its own head position, and members serve
+// their parts of a request concurrently, so a request costs as much
+// as its slowest member.
+//
 class DiskSystem {
  private:
-  BYTE_T *bitmap;
-  FILE*  datafilefd;
-  FILE*  configfilefd;
-  FILE*  bitmapfilefd;
+  // The bitmap is mmap'd from filestem.bitmap on first use
+  mutable BYTE_T *bitmap;
+  int    datafilefd;
+  int    configfd;
+  int    bitmapfd;
+  bool   configdirty;
+  // with checksums, mmap'd from filestem.crc on first use
+  mutable uint32_t *crctable;
+  int    crcfd;
+  // with compression, mmap'd from filestem.map on first use
+  mutable uint32_t *packtable;
+  int    packfd;
 
 
   //
@@ -41,21 +68,108 @@ class DiskSystem {
   double trackseeklatency;
   double rotationallatency;
 
+  // stripe set only, nummembers==1 for a plain disk
+  SIZE_T nummembers;
+  SIZE_T stripeunit;
+  vector<DiskSystem *> members;
+
+  // CRC32C of each block, kept in filestem.crc and checked on read
+  bool   checksums;
+
+  // blocks are compressed, and packed together, see disksystem.cc
+  bool   compress;
+
+  Trace *trace;
+
+  DurabilityMode durability;
+  double durabilityparam;
+  SIZE_T pendingwrites;   // write requests since the last sync
+  uint64_t lastsync;      // Trace::Now() of the last sync
+  SIZE_T numsyncs;
+  double synctime;        // wall clock ms spent syncing
+
  protected:
-  virtual double ModelAccess(const SIZE_T off, const SIZE_T num);
+  // numbytes, if given, is how much of the blocks is transferred
+  virtual double ModelAccess(const SIZE_T off, const SIZE_T num, const SIZE_T numbytes=0);
 
   ERROR_T SanityCheckConfig();
   ERROR_T InitFromConfigFile();
-  ERROR_T InitFromInMemoryConfig();
+  ERROR_T InitFromInMemoryConfig(const bool prealloc);
   ERROR_T ReadConfig();
+  ERROR_T ReadTextConfig();
   ERROR_T WriteConfig();
-  ERROR_T ReadBitMap();
-  ERROR_T WriteBitMap();
+  SIZE_T  GetNumBitMapBytes() const;
+  ERROR_T MapBitMap() const;
+  ERROR_T UnmapBitMap();
+  ERROR_T MapCRCTable() const;
+  ERROR_T UnmapCRCTable();
+  ERROR_T InitCRCTable(const SIZE_T from);
+  ERROR_T MapPackTable() const;
+  ERROR_T UnmapPackTable();
+  ERROR_T InitPackTable(const SIZE_T from);
+
+  ERROR_T DoRead(const SIZE_T inoffblock,
+		 const SIZE_T numblock,
+		 vector<Block> &blocks,
+		 double &reqtime);
+  ERROR_T DoWrite(const SIZE_T inoffblock,
+		  const SIZE_T numblock,
+		  const vector<Block> &blocks,
+		  double &reqtime);
+
+  ERROR_T PackedRead(const SIZE_T inoffblock,
+		     const SIZE_T numblock,
+		     vector<Block> &blocks,
+		     double &reqtime);
+  ERROR_T PackedWrite(const SIZE_T inoffblock,
+		      const SIZE_T numblock,
+		      const vector<Block> &blocks,
+		      double &reqtime);
+  SIZE_T  PackRoom(const SIZE_T block) const;
+  ERROR_T Repack(const SIZE_T first,
+		 const SIZE_T from,
+		 const vector<Block> &images,
+		 const vector<SIZE_T> &lengths,
+		 double &reqtime);
+
+  ERROR_T Sync();
+
+  bool    IsStriped() const { return nummembers>1; }
+  ERROR_T CreateMembers(const bool prealloc);
+  ERROR_T OpenMembers();
+  void    MapStripedBlock(const SIZE_T block, SIZE_T &member, SIZE_T &memberblock) const;
+  ERROR_T StripedAccess(const bool write,
+			const SIZE_T inoffblock,
+			const SIZE_T numblock,
+			const vector<Block> &inblocks,
+			vector<Block> &outblocks,
+			double &reqtime);
   
    
  public:
   // The data is stored in file "filestem.data"
   // The config is stored in file "filestem.config"
+  //   (a binary header, see disksystem.cc; text configs are still read)
+  // The allocation bitmap is stored in file "filestem.bitmap"
+  //
+  // If prealloc is set when creating, the whole data extent is 
+  // reserved up front with fallocate
+  //
+  // If members>1 when creating, this is a stripe set and the
+  // members are stored as "filestem.0" ... "filestem.<members-1>".
+  // blocks is then the total over all the members, and the
+  // geometry and performance describe each member.
+  //
+  // If checksums is set when creating, the CRC32C of each block is 
+  // kept in "filestem.crc" and every read is checked against it
+  // (ERROR_CHECKSUM).  In a stripe set each member keeps its own.
+  //
+  // If compress is set when creating, blocks are compressed when they
+  // are written and decompressed when they are read, and the 
+  // compressed blocks of each group of DISKSYSTEM_PACK_GROUP are 
+  // packed together, so that reading one transfers only its bytes.
+  // Where each block is is kept in "filestem.map".  In a stripe set
+  // each member compresses its own.
 
   DiskSystem(const string &filestem,
 	     const bool create=false,
@@ -67,7 +181,12 @@ class DiskSystem {
 	     const SIZE_T tracks=0,
 	     const double avgseek=0,
 	     const double trackseek=0,
-	     const double rotlat=0);
+	     const double rotlat=0,
+	     const bool prealloc=false,
+	     const SIZE_T members=1,
+	     const SIZE_T stripeunit=1,
+	     const bool checksums=false,
+	     const bool compress=false);
   DiskSystem() { throw GenericException(); } 
   DiskSystem(const DiskSystem &rhs) { throw GenericException();}
   DiskSystem & operator=(const DiskSystem &rhs) { throw GenericException(); return *this;}
@@ -97,6 +216,24 @@ class DiskSystem {
   SIZE_T GetBlockSize() const;
   SIZE_T GetNumBlocks() const;
 
+  // Add at least newblocks blocks to the end of the disk, in place
+  // Check GetNumBlocks for how many were actually added
+  ERROR_T Grow(const SIZE_T newblocks);
+
+  // Record every request in the trace (0 to stop)
+  void SetTrace(Trace *trace);
+
+  // param is N for DURABILITY_EVERYN and ms for DURABILITY_GROUP
+  // The default is DURABILITY_NONE
+  void SetDurability(const DurabilityMode mode, const double param=0);
+  // Make every write so far durable, unless the mode is DURABILITY_NONE
+  ERROR_T Commit();
+
+  // Syncs are real, not simulated, so their cost is wall clock time
+  // and is kept separately from the simulated request times
+  SIZE_T GetNumSyncs() const { return numsyncs; }
+  double GetSyncTime() const { return synctime; }
+
   //
   // These are notification functions that should be called when
   // a block is allocated or deallocated.  They keep the bitmap updated
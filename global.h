@@ -3,7 +3,9 @@
 
 
 typedef unsigned char BYTE_T;
-typedef unsigned int SIZE_T;
+// Block numbers, byte offsets and lengths are 64 bits wide so that
+// disks and indexes can grow past 4G blocks / 4 GB of data
+typedef unsigned long long SIZE_T;
 typedef int ERROR_T;
 
 
@@ -28,6 +30,7 @@ const ERROR_T ERROR_INNERLOOP=-16;
 const ERROR_T ERROR_BADORDER=-17;
 const ERROR_T ERROR_NODEOVERFLOW=-18;
 const ERROR_T ERROR_BADNODETYPE=-19;
+const ERROR_T ERROR_CHECKSUM=-20;
 
 struct GenericException {};
 
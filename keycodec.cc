@@ -0,0 +1,136 @@
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+
+#include "keycodec.h"
+
+static const char *codecnames[] = { "NONE", "ALNUM" };
+
+#define ALNUM_BITS 6
+
+
+// The ALNUM code for c, or 0 if it has none
+static unsigned AlnumCode(const BYTE_T c)
+{
+  if (c>='0' && c<='9') { 
+    return 1+c-'0';
+  }
+  if (c>='a' && c<='z') { 
+    return 11+c-'a';
+  }
+  return 0;
+}
+
+static char AlnumChar(const unsigned code)
+{
+  return code<=10 ? '0'+code-1 : code<=36 ? 'a'+code-11 : '?';
+}
+
+
+KeyCodec::KeyCodec()
+{
+  codec=KEYCODEC_NONE;
+  keysize=0;
+}
+
+SIZE_T KeyCodec::PackedSize(const SIZE_T n) const
+{
+  return codec==KEYCODEC_ALNUM ? (ALNUM_BITS*n+7)/8 : n;
+}
+
+ERROR_T KeyCodec::Pack(const Block &key, Block &packed) const
+{
+  if (codec!=KEYCODEC_ALNUM) { 
+    packed=key;
+    return ERROR_NOERROR;
+  }
+
+  if (packed.Resize(PackedSize(key.length),false)!=ERROR_NOERROR) { 
+    return ERROR_NOMEM;
+  }
+  memset(packed.data,0,packed.length);
+
+  for (SIZE_T i=0;i<key.length;i++) { 
+    unsigned code=AlnumCode(key.data[i]);
+    if (code==0) { 
+      return ERROR_SIZE;
+    }
+    // the code's bits, in a 16 bit window at the byte it starts in
+    SIZE_T bit=ALNUM_BITS*i;
+    unsigned w=code<<(16-ALNUM_BITS-bit%8);
+    packed.data[bit/8]|=w>>8;
+    if (w&0xff) { 
+      packed.data[bit/8+1]|=w&0xff;
+    }
+  }
+  return ERROR_NOERROR;
+}
+
+void KeyCodec::Unpack(const char *packed, const SIZE_T len, Block &key) const
+{
+  if (codec!=KEYCODEC_ALNUM) { 
+    key.Resize(len,false);
+    memcpy(key.data,packed,len);
+    return;
+  }
+
+  const BYTE_T *p=(const BYTE_T *)packed;
+  SIZE_T n=0;
+  // the longest key that could have been packed into len bytes,
+  // less any that ended early
+  key.Resize(8*len/ALNUM_BITS,false);
+  for (SIZE_T bit=0;bit+ALNUM_BITS<=8*len;bit+=ALNUM_BITS) { 
+    unsigned w=p[bit/8]<<8 | (bit/8+1<len ? p[bit/8+1] : 0);
+    unsigned code=(w>>(16-ALNUM_BITS-bit%8)) & ((1<<ALNUM_BITS)-1);
+    if (code==0) { 
+      break;
+    }
+    key.data[n++]=AlnumChar(code);
+  }
+  key.Resize(n);
+}
+
+
+//
+// In the superblock, just past the key order (see keyorder.h):
+//   u32 codec, u32 keysize
+// Superblocks written before there were codecs have zeros here, and
+// so have none.
+//
+SIZE_T KeyCodec::EncodedSize()
+{
+  return 2*sizeof(uint32_t);
+}
+
+void KeyCodec::Encode(char *buf) const
+{
+  uint32_t w[2] = { (uint32_t)codec, (uint32_t)keysize };
+  memcpy(buf,w,sizeof(w));
+}
+
+ERROR_T KeyCodec::Decode(const char *buf)
+{
+  uint32_t w[2];
+
+  memcpy(w,buf,sizeof(w));
+  codec=w[0];
+  keysize=w[1];
+  return codec>=KEYCODEC_NONE && codec<=KEYCODEC_ALNUM ? ERROR_NOERROR : ERROR_INSANE;
+}
+
+ostream & KeyCodec::Print(ostream &os) const
+{
+  return os << (codec>=KEYCODEC_NONE && codec<=KEYCODEC_ALNUM ? codecnames[codec] : "UNKNOWN_CODEC");
+}
+
+int KeyCodecByName(const char *name, KeyCodec &codec)
+{
+  for (int i=KEYCODEC_NONE;i<=KEYCODEC_ALNUM;i++) { 
+    if (!strcasecmp(name,codecnames[i])) { 
+      codec=KeyCodec();
+      codec.codec=i;
+      return i;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,65 @@
+#ifndef _keycodec
+#define _keycodec
+
+#include <iostream>
+
+#include "global.h"
+#include "block.h"
+
+using namespace std;
+
+//
+// Key codecs
+//
+// An index may store its keys packed by one of these, chosen when it
+// is created and recorded in its superblock.  Keys are packed as they
+// come in through Insert, Update and Lookup, and unpacked only to be
+// displayed, so the nodes see only packed keys, and superblock 
+// keysize is the size of a packed key.
+//
+#define KEYCODEC_NONE 0    // keys are stored as they are
+#define KEYCODEC_ALNUM 1   // keys of 0-9 and a-z, 6 bits per character
+//
+// A packed ALNUM key is the big endian bit string of its characters'
+// codes, '0' to '9' as 1 to 10 and 'a' to 'z' as 11 to 36, zero
+// padded to a whole byte.  That's the characters' order, and a code
+// is never 0, so packed keys compare with memcmp the way the keys
+// they pack do, as a shorter key that matches a longer one is less.
+// So an index with a codec is in binary order (see keyorder.h), and
+// its packed keys need no unpacking to be searched.  Separators are
+// shortened before they're packed (see BTreeIndex::SplitSeparator),
+// and where keys are all one size, the zeros they're padded with 
+// unpack to nothing.
+//
+
+struct KeyCodec {
+  int    codec;
+  SIZE_T keysize;   // size of an unpacked key, the index's keysize
+                    // as its users see it
+
+  KeyCodec();
+
+  // Bytes a key of n characters packs into
+  SIZE_T  PackedSize(const SIZE_T n) const;
+
+  // Pack key.  ERROR_SIZE if it has a character the codec has no
+  // code for.
+  ERROR_T Pack(const Block &key, Block &packed) const;
+  // Unpack len bytes of a packed key
+  void    Unpack(const char *packed, const SIZE_T len, Block &key) const;
+
+  // Convert to and from the form kept in the superblock
+  static SIZE_T EncodedSize();
+  void    Encode(char *buf) const;
+  ERROR_T Decode(const char *buf);
+
+  ostream &Print(ostream &os) const;
+};
+
+inline ostream & operator<< (ostream &os, const KeyCodec &codec) { return codec.Print(os); }
+
+// Parse name, in any case, into codec: none or alnum.  Returns the
+// codec, or -1 if name isn't one.
+int KeyCodecByName(const char *name, KeyCodec &codec);
+
+#endif
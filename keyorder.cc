@@ -0,0 +1,164 @@
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "keyorder.h"
+
+static const char *ordernames[] = { "BINARY", "UNSIGNED", "SIGNED", "NOCASE", "COMPOSITE" };
+
+
+KeyOrder::KeyOrder()
+{
+  order=KEYORDER_BINARY;
+  numcolumns=0;
+  memset(columns,0,sizeof(columns));
+}
+
+int KeyOrder::Compare(const char *a, const SIZE_T alen, const char *b, const SIZE_T blen) const
+{
+  switch (order) { 
+  case KEYORDER_UNSIGNED:
+    return UnsignedOrder().Compare(a,alen,b,blen);
+  case KEYORDER_SIGNED:
+    return SignedOrder().Compare(a,alen,b,blen);
+  case KEYORDER_NOCASE:
+    return NoCaseOrder().Compare(a,alen,b,blen);
+  case KEYORDER_COMPOSITE:
+    return CompositeOrder(*this).Compare(a,alen,b,blen);
+  default:
+    return BinaryOrder().Compare(a,alen,b,blen);
+  }
+}
+
+bool KeyOrder::Fits(const SIZE_T keysize) const
+{
+  if (order!=KEYORDER_COMPOSITE) { 
+    return true;
+  }
+  SIZE_T width=0;
+  for (int i=0;i<numcolumns;i++) { 
+    if (columns[i].width==0 && i+1<numcolumns) { 
+      return false;
+    }
+    width+=columns[i].width;
+  }
+  return numcolumns>0 && width<=keysize;
+}
+
+
+//
+// In the superblock, just past the header: 
+//   u32 order, u32 numcolumns, then for each of KEYORDER_MAXCOLUMNS
+//   columns u32 order, u32 width
+// Superblocks written before there were key orders have zeros here,
+// and so are BINARY.
+//
+SIZE_T KeyOrder::EncodedSize()
+{
+  return (2+2*KEYORDER_MAXCOLUMNS)*sizeof(uint32_t);
+}
+
+void KeyOrder::Encode(char *buf) const
+{
+  uint32_t w[2+2*KEYORDER_MAXCOLUMNS];
+
+  w[0]=order;
+  w[1]=numcolumns;
+  for (int i=0;i<KEYORDER_MAXCOLUMNS;i++) { 
+    w[2+2*i]=columns[i].order;
+    w[3+2*i]=columns[i].width;
+  }
+  memcpy(buf,w,sizeof(w));
+}
+
+ERROR_T KeyOrder::Decode(const char *buf)
+{
+  uint32_t w[2+2*KEYORDER_MAXCOLUMNS];
+
+  memcpy(w,buf,sizeof(w));
+  order=w[0];
+  numcolumns=w[1];
+  if (order<KEYORDER_BINARY || order>KEYORDER_COMPOSITE || 
+      numcolumns<0 || numcolumns>KEYORDER_MAXCOLUMNS) { 
+    return ERROR_INSANE;
+  }
+  for (int i=0;i<KEYORDER_MAXCOLUMNS;i++) { 
+    columns[i].order=w[2+2*i];
+    columns[i].width=w[3+2*i];
+    if (columns[i].order<KEYORDER_BINARY || columns[i].order>=KEYORDER_COMPOSITE) { 
+      return ERROR_INSANE;
+    }
+  }
+  return ERROR_NOERROR;
+}
+
+ostream & KeyOrder::Print(ostream &os) const
+{
+  if (order!=KEYORDER_COMPOSITE) { 
+    return os << (order>=0 && order<KEYORDER_COMPOSITE ? ordernames[order] : "UNKNOWN_ORDER");
+  }
+  for (int i=0;i<numcolumns;i++) { 
+    os << (i ? "," : "") << ordernames[columns[i].order];
+    if (columns[i].width) { 
+      os << ":" << columns[i].width;
+    }
+  }
+  return os;
+}
+
+
+// The simple order called name, which ends at end
+static int SimpleOrderByName(const char *name, const char *end)
+{
+  for (int i=KEYORDER_BINARY;i<KEYORDER_COMPOSITE;i++) { 
+    if (strlen(ordernames[i])==(size_t)(end-name) && !strncasecmp(name,ordernames[i],end-name)) { 
+      return i;
+    }
+  }
+  return -1;
+}
+
+int KeyOrderByName(const char *name, KeyOrder &order)
+{
+  KeyOrder o;
+
+  if (!strchr(name,',') && !strchr(name,':')) { 
+    o.order=SimpleOrderByName(name,name+strlen(name));
+    if (o.order<0) { 
+      return -1;
+    }
+    order=o;
+    return order.order;
+  }
+
+  o.order=KEYORDER_COMPOSITE;
+  for (const char *p=name; ; ) { 
+    const char *end=p+strcspn(p,":,");
+    if (o.numcolumns==KEYORDER_MAXCOLUMNS) { 
+      return -1;
+    }
+    KeyColumn &col=o.columns[o.numcolumns++];
+    if ((col.order=SimpleOrderByName(p,end))<0) { 
+      return -1;
+    }
+    p=end;
+    if (*p==':') { 
+      char *after;
+      col.width=strtoul(p+1,&after,10);
+      if (after==p+1 || col.width==0) { 
+	return -1;
+      }
+      p=after;
+    }
+    if (*p==0) { 
+      break;
+    }
+    if (*p!=',' || col.width==0) { 
+      return -1;
+    }
+    p++;
+  }
+  order=o;
+  return order.order;
+}
@@ -0,0 +1,211 @@
+#ifndef _keyorder
+#define _keyorder
+
+#include <iostream>
+#include <string.h>
+#include <stdint.h>
+
+#include "global.h"
+
+using namespace std;
+
+//
+// Key orders
+//
+// An index orders its keys one of these ways, chosen when it is
+// created and recorded in its superblock:
+//
+#define KEYORDER_BINARY 0     // as memcmp does; a shorter key that matches
+                              // a longer one as far as it goes is less
+#define KEYORDER_UNSIGNED 1   // as little endian unsigned integers
+#define KEYORDER_SIGNED 2     // as little endian two's complement integers
+#define KEYORDER_NOCASE 3     // as BINARY, with ASCII letters folded to
+                              // lower case
+#define KEYORDER_COMPOSITE 4  // column by column, each in one of the above
+#define KEYORDER_MAXCOLUMNS 8
+//
+// Integers of different lengths compare by value, as though the
+// shorter were extended.  NOCASE and composite orders can make keys
+// that differ equal, and then a unique index holds only one of them.
+//
+// Only BINARY agrees with the search kernels (see keysearch.h) and
+// with separator shortening (see BTreeIndex::SplitSeparator), so an
+// index in any other order does without them.
+//
+
+struct KeyColumn {
+  int    order;   // KEYORDER_BINARY to KEYORDER_NOCASE
+  SIZE_T width;   // bytes, or 0 for the rest of the key (last column only)
+};
+
+struct KeyOrder {
+  int       order;
+  int       numcolumns;   // meaningful only for KEYORDER_COMPOSITE
+  KeyColumn columns[KEYORDER_MAXCOLUMNS];
+
+  KeyOrder();
+
+  // <0, 0, >0 as key a (of alen bytes) is less than, equal to, or
+  // greater than key b
+  int     Compare(const char *a, const SIZE_T alen, const char *b, const SIZE_T blen) const;
+
+  // Whether the columns fit in keys of keysize bytes
+  bool    Fits(const SIZE_T keysize) const;
+
+  // Convert to and from the form kept in the superblock
+  static SIZE_T EncodedSize();
+  void    Encode(char *buf) const;
+  ERROR_T Decode(const char *buf);
+
+  ostream &Print(ostream &os) const;
+};
+
+inline ostream & operator<< (ostream &os, const KeyOrder &order) { return order.Print(os); }
+
+// Parse name, in any case, into order: binary, unsigned, signed or
+// nocase, or a composite of comma separated columns, each one of
+// those and a width, as in "unsigned:4,nocase:12", where the last
+// width may be left off to mean the rest of the key.  Returns the
+// order, or -1 if name isn't one.
+int KeyOrderByName(const char *name, KeyOrder &order);
+
+
+//
+// The orders as policies
+//
+// Each has a Compare like KeyOrder::Compare, so that code templated
+// on the policy, like the node searches in btree_ds.cc, has the
+// comparison inlined into it instead of dispatching on the order for
+// every key it looks at.
+//
+struct BinaryOrder {
+  int Compare(const char *a, const SIZE_T alen, const char *b, const SIZE_T blen) const {
+    int c=memcmp(a,b,alen<blen ? alen : blen);
+    if (c) {
+      return c;
+    }
+    return alen<blen ? -1 : alen>blen ? 1 : 0;
+  }
+};
+
+// Compare from the most significant byte down, with the shorter
+// integer extended by ext bytes
+static inline int CompareLittleEndian(const unsigned char *a, const SIZE_T alen, const unsigned char aext,
+				      const unsigned char *b, const SIZE_T blen, const unsigned char bext)
+{
+  for (SIZE_T i=alen>blen ? alen : blen; i>0; i--) {
+    unsigned char x= i<=alen ? a[i-1] : aext;
+    unsigned char y= i<=blen ? b[i-1] : bext;
+    if (x!=y) {
+      return x<y ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+struct UnsignedOrder {
+  int Compare(const char *a, const SIZE_T alen, const char *b, const SIZE_T blen) const {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (alen==blen && alen==sizeof(uint64_t)) {
+      uint64_t x, y;
+      memcpy(&x,a,sizeof(x));
+      memcpy(&y,b,sizeof(y));
+      return x<y ? -1 : x>y ? 1 : 0;
+    }
+    if (alen==blen && alen==sizeof(uint32_t)) {
+      uint32_t x, y;
+      memcpy(&x,a,sizeof(x));
+      memcpy(&y,b,sizeof(y));
+      return x<y ? -1 : x>y ? 1 : 0;
+    }
+#endif
+    return CompareLittleEndian((const unsigned char*)a,alen,0,(const unsigned char*)b,blen,0);
+  }
+};
+
+struct SignedOrder {
+  int Compare(const char *a, const SIZE_T alen, const char *b, const SIZE_T blen) const {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (alen==blen && alen==sizeof(int64_t)) {
+      int64_t x, y;
+      memcpy(&x,a,sizeof(x));
+      memcpy(&y,b,sizeof(y));
+      return x<y ? -1 : x>y ? 1 : 0;
+    }
+    if (alen==blen && alen==sizeof(int32_t)) {
+      int32_t x, y;
+      memcpy(&x,a,sizeof(x));
+      memcpy(&y,b,sizeof(y));
+      return x<y ? -1 : x>y ? 1 : 0;
+    }
+#endif
+    // a negative integer is less than any other, and two of the same
+    // sign, sign extended, compare as unsigned ones do
+    unsigned char aext= alen>0 && (a[alen-1]&0x80) ? 0xff : 0;
+    unsigned char bext= blen>0 && (b[blen-1]&0x80) ? 0xff : 0;
+    if (aext!=bext) {
+      return aext ? -1 : 1;
+    }
+    return CompareLittleEndian((const unsigned char*)a,alen,aext,(const unsigned char*)b,blen,bext);
+  }
+};
+
+struct NoCaseOrder {
+  int Compare(const char *a, const SIZE_T alen, const char *b, const SIZE_T blen) const {
+    SIZE_T n=alen<blen ? alen : blen;
+    for (SIZE_T i=0;i<n;i++) {
+      unsigned char x=a[i], y=b[i];
+      if (x>='A' && x<='Z') { x+='a'-'A'; }
+      if (y>='A' && y<='Z') { y+='a'-'A'; }
+      if (x!=y) {
+	return x<y ? -1 : 1;
+      }
+    }
+    return alen<blen ? -1 : alen>blen ? 1 : 0;
+  }
+};
+
+// Columns that a key is too short to have all of are compared as far
+// as it goes, and bytes past the last column in binary order
+struct CompositeOrder {
+  const KeyOrder &order;
+
+  CompositeOrder(const KeyOrder &o) : order(o) {}
+
+  int Compare(const char *a, const SIZE_T alen, const char *b, const SIZE_T blen) const {
+    SIZE_T at=0;
+    for (int i=0;i<order.numcolumns;i++) {
+      const KeyColumn &col=order.columns[i];
+      SIZE_T aw= at>=alen ? 0 : col.width==0 || alen-at<col.width ? alen-at : col.width;
+      SIZE_T bw= at>=blen ? 0 : col.width==0 || blen-at<col.width ? blen-at : col.width;
+      const char *x=a+(at<alen ? at : alen);
+      const char *y=b+(at<blen ? at : blen);
+      int c;
+      switch (col.order) {
+      case KEYORDER_UNSIGNED:
+	c=UnsignedOrder().Compare(x,aw,y,bw);
+	break;
+      case KEYORDER_SIGNED:
+	c=SignedOrder().Compare(x,aw,y,bw);
+	break;
+      case KEYORDER_NOCASE:
+	c=NoCaseOrder().Compare(x,aw,y,bw);
+	break;
+      default:
+	c=BinaryOrder().Compare(x,aw,y,bw);
+	break;
+      }
+      if (c) {
+	return c;
+      }
+      if (col.width==0) {
+	return 0;
+      }
+      at+=col.width;
+    }
+    return BinaryOrder().Compare(a+(at<alen ? at : alen),at<alen ? alen-at : 0,
+				 b+(at<blen ? at : blen),at<blen ? blen-at : 0);
+  }
+};
+
+#endif
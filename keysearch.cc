@@ -0,0 +1,269 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "keysearch.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEYSEARCH_HAVE_X86 1
+#endif
+
+//
+// The vector kernels binary search until at most this many keys are
+// left, then compare all of those, a vector at a time, and take the
+// first key that is not counted from the compare mask.  With typical
+// fanouts that's a few probes plus one or two vector compares.
+//
+#define KEYSEARCH_WINDOW 32
+
+
+static inline uint32_t load_be32(const char *p)
+{
+  uint32_t w;
+  memcpy(&w,p,sizeof(w));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  w=__builtin_bswap32(w);
+#endif
+  return w;
+}
+
+static inline uint64_t load_be64(const char *p)
+{
+  uint64_t w;
+  memcpy(&w,p,sizeof(w));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  w=__builtin_bswap64(w);
+#endif
+  return w;
+}
+
+// Narrow [lo,hi) to at most window keys that contain the answer
+static inline void narrow32(const char *keys, const SIZE_T stride, const uint32_t k, 
+			    const bool strict, const SIZE_T window, SIZE_T &lo, SIZE_T &hi)
+{
+  while (hi-lo>window) { 
+    SIZE_T mid=lo+(hi-lo)/2;
+    uint32_t m=load_be32(keys+mid*stride);
+    if (m<k || (strict && m==k)) { 
+      lo=mid+1;
+    } else {
+      hi=mid;
+    }
+  }
+}
+
+static inline void narrow64(const char *keys, const SIZE_T stride, const uint64_t k, 
+			    const bool strict, const SIZE_T window, SIZE_T &lo, SIZE_T &hi)
+{
+  while (hi-lo>window) { 
+    SIZE_T mid=lo+(hi-lo)/2;
+    uint64_t m=load_be64(keys+mid*stride);
+    if (m<k || (strict && m==k)) { 
+      lo=mid+1;
+    } else {
+      hi=mid;
+    }
+  }
+}
+
+
+static SIZE_T keysearch4_scalar(const char *keys, const SIZE_T stride, const SIZE_T numkeys,
+				const char *key, const bool strict)
+{
+  SIZE_T lo=0, hi=numkeys;
+  narrow32(keys,stride,load_be32(key),strict,0,lo,hi);
+  return lo;
+}
+
+static SIZE_T keysearch8_scalar(const char *keys, const SIZE_T stride, const SIZE_T numkeys,
+				const char *key, const bool strict)
+{
+  SIZE_T lo=0, hi=numkeys;
+  narrow64(keys,stride,load_be64(key),strict,0,lo,hi);
+  return lo;
+}
+
+
+#ifdef KEYSEARCH_HAVE_X86
+
+//
+// Unsigned compares are done as signed compares of the values with
+// their top bits flipped.  A lane is counted if its key is less than
+// key, or, if strict, not greater than key.
+//
+
+__attribute__((target("sse2")))
+static SIZE_T keysearch4_sse2(const char *keys, const SIZE_T stride, const SIZE_T numkeys,
+			      const char *key, const bool strict)
+{
+  const uint32_t k=load_be32(key);
+  SIZE_T lo=0, hi=numkeys;
+
+  narrow32(keys,stride,k,strict,KEYSEARCH_WINDOW,lo,hi);
+
+  const __m128i kv=_mm_set1_epi32((int)(k^0x80000000u));
+  for (;lo+4<=hi;lo+=4) { 
+    const char *p=keys+lo*stride;
+    __m128i v=_mm_setr_epi32((int)(load_be32(p)^0x80000000u),
+			     (int)(load_be32(p+stride)^0x80000000u),
+			     (int)(load_be32(p+2*stride)^0x80000000u),
+			     (int)(load_be32(p+3*stride)^0x80000000u));
+    unsigned mask = strict ? (~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v,kv)))) & 0xf
+                           : _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(kv,v)));
+    if (mask!=0xf) { 
+      return lo+__builtin_ctz(~mask);
+    }
+  }
+  narrow32(keys,stride,k,strict,0,lo,hi);
+  return lo;
+}
+
+__attribute__((target("sse4.2")))
+static SIZE_T keysearch8_sse42(const char *keys, const SIZE_T stride, const SIZE_T numkeys,
+			       const char *key, const bool strict)
+{
+  const uint64_t k=load_be64(key);
+  SIZE_T lo=0, hi=numkeys;
+
+  narrow64(keys,stride,k,strict,KEYSEARCH_WINDOW,lo,hi);
+
+  const __m128i kv=_mm_set1_epi64x((long long)(k^0x8000000000000000ull));
+  for (;lo+2<=hi;lo+=2) { 
+    const char *p=keys+lo*stride;
+    __m128i v=_mm_set_epi64x((long long)(load_be64(p+stride)^0x8000000000000000ull),
+			     (long long)(load_be64(p)^0x8000000000000000ull));
+    unsigned mask = strict ? (~_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(v,kv)))) & 0x3
+                           : _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(kv,v)));
+    if (mask!=0x3) { 
+      return lo+__builtin_ctz(~mask);
+    }
+  }
+  narrow64(keys,stride,k,strict,0,lo,hi);
+  return lo;
+}
+
+//
+// AVX2 loads 8 (4) keys at a time, directly if they are adjacent and
+// with a gather if they are interleaved with pointers or values, then
+// byte swaps them to big endian in the register
+//
+
+__attribute__((target("avx2")))
+static SIZE_T keysearch4_avx2(const char *keys, const SIZE_T stride, const SIZE_T numkeys,
+			      const char *key, const bool strict)
+{
+  const uint32_t k=load_be32(key);
+  SIZE_T lo=0, hi=numkeys;
+
+  narrow32(keys,stride,k,strict,KEYSEARCH_WINDOW,lo,hi);
+
+  const __m256i bswap=_mm256_setr_epi8(3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12,
+				       3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12);
+  const __m256i flip=_mm256_set1_epi32((int)0x80000000u);
+  const __m256i kv=_mm256_set1_epi32((int)(k^0x80000000u));
+  const __m256i idx=_mm256_mullo_epi32(_mm256_setr_epi32(0,1,2,3,4,5,6,7),
+				       _mm256_set1_epi32((int)stride));
+  for (;lo+8<=hi;lo+=8) { 
+    const char *p=keys+lo*stride;
+    __m256i v = stride==4 ? _mm256_loadu_si256((const __m256i *)p)
+                          : _mm256_i32gather_epi32((const int *)p,idx,1);
+    v=_mm256_xor_si256(_mm256_shuffle_epi8(v,bswap),flip);
+    unsigned mask = strict ? (~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v,kv)))) & 0xff
+                           : _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(kv,v)));
+    if (mask!=0xff) { 
+      return lo+__builtin_ctz(~mask);
+    }
+  }
+  narrow32(keys,stride,k,strict,0,lo,hi);
+  return lo;
+}
+
+__attribute__((target("avx2")))
+static SIZE_T keysearch8_avx2(const char *keys, const SIZE_T stride, const SIZE_T numkeys,
+			      const char *key, const bool strict)
+{
+  const uint64_t k=load_be64(key);
+  SIZE_T lo=0, hi=numkeys;
+
+  narrow64(keys,stride,k,strict,KEYSEARCH_WINDOW,lo,hi);
+
+  const __m256i bswap=_mm256_setr_epi8(7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8,
+				       7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8);
+  const __m256i flip=_mm256_set1_epi64x((long long)0x8000000000000000ull);
+  const __m256i kv=_mm256_set1_epi64x((long long)(k^0x8000000000000000ull));
+  const __m128i idx=_mm_mullo_epi32(_mm_setr_epi32(0,1,2,3),_mm_set1_epi32((int)stride));
+  for (;lo+4<=hi;lo+=4) { 
+    const char *p=keys+lo*stride;
+    __m256i v = stride==8 ? _mm256_loadu_si256((const __m256i *)p)
+                          : _mm256_i32gather_epi64((const long long *)p,idx,1);
+    v=_mm256_xor_si256(_mm256_shuffle_epi8(v,bswap),flip);
+    unsigned mask = strict ? (~_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v,kv)))) & 0xf
+                           : _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(kv,v)));
+    if (mask!=0xf) { 
+      return lo+__builtin_ctz(~mask);
+    }
+  }
+  narrow64(keys,stride,k,strict,0,lo,hi);
+  return lo;
+}
+
+#endif
+
+
+KeySearchKernel keysearch_choose(const SIZE_T keysize)
+{
+  switch (keysize) { 
+  case 4:
+#ifdef KEYSEARCH_HAVE_X86
+    if (__builtin_cpu_supports("avx2")) { 
+      return keysearch4_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) { 
+      return keysearch4_sse2;
+    }
+#endif
+    return keysearch4_scalar;
+  case 8:
+#ifdef KEYSEARCH_HAVE_X86
+    if (__builtin_cpu_supports("avx2")) { 
+      return keysearch8_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) { 
+      return keysearch8_sse42;
+    }
+#endif
+    return keysearch8_scalar;
+  default:
+    return 0;
+  }
+}
+
+
+KeySearchStats::KeySearchStats() : interpolate(true), searches(0), probes(0), bisections(0), idle(0)
+{
+}
+
+void KeySearchStats::Record(const SIZE_T numkeys, const SIZE_T n)
+{
+  SIZE_T log2=0;
+  while (((SIZE_T)1<<log2)<=numkeys) { 
+    log2++;
+  }
+  searches++;
+  probes+=n;
+  bisections+=log2;
+  if (searches==KEYSEARCH_SAMPLE) { 
+    if (probes>=bisections) { 
+      interpolate=false;
+      idle=KEYSEARCH_SAMPLE*KEYSEARCH_RETRY;
+    }
+    searches=probes=bisections=0;
+  }
+}
+
+void KeySearchStats::Skip()
+{
+  if (!interpolate && --idle==0) { 
+    interpolate=true;
+  }
+}
@@ -0,0 +1,64 @@
+#ifndef _keysearch
+#define _keysearch
+
+#include "global.h"
+
+//
+// Search kernels for fixed width keys
+//
+// A kernel counts how many of numkeys sorted keys, stride bytes apart
+// starting at keys, are less than key (or, if strict, less than or
+// equal to key), comparing the way memcmp does.  That count is both
+// the lower (upper) bound within a leaf and the pointer to follow in
+// an interior node.
+//
+// There are kernels for 4 and 8 byte keys, which compare the keys as
+// big endian unsigned integers, with AVX2 (gathering and comparing 8
+// or 4 keys per instruction), with SSE, or with plain integer
+// compares, depending on what the CPU has.
+//
+typedef SIZE_T (*KeySearchKernel)(const char *keys, const SIZE_T stride,
+				  const SIZE_T numkeys, const char *key,
+				  const bool strict);
+
+// The best kernel for keys of keysize bytes, or 0 if there is none
+// and the generic (memcmp) search should be used
+KeySearchKernel keysearch_choose(const SIZE_T keysize);
+
+
+//
+// Interpolation search
+//
+// Where keys are spread evenly, as hashed ones are, guessing where a
+// key falls from its value and the values around it finds it in a 
+// probe or two, instead of the log2(numkeys) of a binary search, and
+// where they aren't, it can take many more.  So an index keeps these
+// statistics of how its interpolation searches have gone, and 
+// searches by interpolation only while they say it pays (see 
+// BTreeNode::FindKey).
+//
+// Searches interpolate in samples of KEYSEARCH_SAMPLE.  If a sample 
+// looks at no fewer keys than binary searches would have, the next
+// KEYSEARCH_SAMPLE*KEYSEARCH_RETRY searches don't interpolate, and
+// then it's tried again, in case the keys have changed.  A search
+// with a kernel counts as a binary search.
+//
+#define KEYSEARCH_SAMPLE 64
+#define KEYSEARCH_RETRY  16
+
+struct KeySearchStats {
+  bool   interpolate;  // whether searches interpolate now
+  SIZE_T searches;     // interpolation searches in this sample
+  SIZE_T probes;       // keys they looked at
+  SIZE_T bisections;   // keys binary searches would have looked at
+  SIZE_T idle;         // searches left before interpolating again
+
+  KeySearchStats();
+
+  // An interpolation search of numkeys keys that looked at probes of them
+  void Record(const SIZE_T numkeys, const SIZE_T probes);
+  // A search that didn't interpolate
+  void Skip();
+};
+
+#endif
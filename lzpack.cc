@@ -0,0 +1,160 @@
+#include <string.h>
+#include <stdint.h>
+
+#include "lzpack.h"
+
+#define LZPACK_MINMATCH  4
+#define LZPACK_MAXOFFSET 0xffff
+#define LZPACK_HASHBITS  12
+
+static inline uint32_t lzpack_load32(const BYTE_T *p)
+{
+  uint32_t w;
+  memcpy(&w,p,sizeof(w));
+  return w;
+}
+
+static inline unsigned lzpack_hash(const uint32_t w)
+{
+  return (w*2654435761u)>>(32-LZPACK_HASHBITS);
+}
+
+// Append count, less the 15 its nibble already holds, as extension bytes
+static bool lzpack_putcount(BYTE_T *out, SIZE_T &op, const SIZE_T outmax, SIZE_T count)
+{
+  for (count-=15; ; count-=255) {
+    if (op>=outmax) {
+      return false;
+    }
+    out[op++]= count>=255 ? 255 : count;
+    if (count<255) {
+      return true;
+    }
+  }
+}
+
+// Append a sequence: litlen literals, then a match of mlen bytes at
+// offset back, or no match if mlen is 0
+static bool lzpack_emit(BYTE_T *out, SIZE_T &op, const SIZE_T outmax,
+			const BYTE_T *lit, const SIZE_T litlen,
+			const SIZE_T offset, const SIZE_T mlen)
+{
+  if (op>=outmax) {
+    return false;
+  }
+  SIZE_T m= mlen ? mlen-LZPACK_MINMATCH : 0;
+  SIZE_T t=op++;
+  out[t]=((litlen<15 ? litlen : 15)<<4) | (m<15 ? m : 15);
+  if (litlen>=15 && !lzpack_putcount(out,op,outmax,litlen)) {
+    return false;
+  }
+  if (op+litlen>outmax) {
+    return false;
+  }
+  memcpy(out+op,lit,litlen);
+  op+=litlen;
+  if (mlen==0) {
+    return true;
+  }
+  if (op+2>outmax) {
+    return false;
+  }
+  out[op++]=offset & 0xff;
+  out[op++]=offset>>8;
+  return m<15 || lzpack_putcount(out,op,outmax,m);
+}
+
+SIZE_T lzpack_compress(const BYTE_T *in, const SIZE_T len, BYTE_T *out, const SIZE_T outmax)
+{
+  SIZE_T table[1<<LZPACK_HASHBITS];   // position+1 of the last 4 bytes that hashed here
+  SIZE_T ip=0, anchor=0, op=0;
+
+  memset(table,0,sizeof(table));
+
+  while (ip+LZPACK_MINMATCH<=len) {
+    uint32_t w=lzpack_load32(in+ip);
+    unsigned h=lzpack_hash(w);
+    SIZE_T cand=table[h];
+    table[h]=ip+1;
+    if (cand==0 || ip-(cand-1)>LZPACK_MAXOFFSET || lzpack_load32(in+cand-1)!=w) {
+      ip++;
+      continue;
+    }
+    SIZE_T ref=cand-1;
+    SIZE_T mlen=LZPACK_MINMATCH;
+    while (ip+mlen<len && in[ref+mlen]==in[ip+mlen]) {
+      mlen++;
+    }
+    if (!lzpack_emit(out,op,outmax,in+anchor,ip-anchor,ip-ref,mlen)) {
+      return 0;
+    }
+    ip+=mlen;
+    anchor=ip;
+  }
+
+  if (!lzpack_emit(out,op,outmax,in+anchor,len-anchor,0,0)) {
+    return 0;
+  }
+  return op;
+}
+
+// Read a count whose nibble was 15
+static bool lzpack_getcount(const BYTE_T *in, SIZE_T &ip, const SIZE_T inlen, SIZE_T &count)
+{
+  BYTE_T b;
+  do {
+    if (ip>=inlen) {
+      return false;
+    }
+    b=in[ip++];
+    count+=b;
+  } while (b==255);
+  return true;
+}
+
+bool lzpack_decompress(const BYTE_T *in, const SIZE_T inlen, BYTE_T *out, const SIZE_T outlen)
+{
+  SIZE_T ip=0, op=0;
+
+  while (ip<inlen) {
+    BYTE_T token=in[ip++];
+    SIZE_T litlen=token>>4;
+    if (litlen==15 && !lzpack_getcount(in,ip,inlen,litlen)) {
+      return false;
+    }
+    if (litlen>inlen-ip || litlen>outlen-op) {
+      return false;
+    }
+    memcpy(out+op,in+ip,litlen);
+    ip+=litlen;
+    op+=litlen;
+    if (ip==inlen) {
+      // the last sequence
+      break;
+    }
+    if (inlen-ip<2) {
+      return false;
+    }
+    SIZE_T offset=in[ip] | (in[ip+1]<<8);
+    ip+=2;
+    SIZE_T mlen=token & 15;
+    if (mlen==15 && !lzpack_getcount(in,ip,inlen,mlen)) {
+      return false;
+    }
+    mlen+=LZPACK_MINMATCH;
+    if (offset==0 || offset>op || mlen>outlen-op) {
+      return false;
+    }
+    if (offset>=mlen) {
+      memcpy(out+op,out+op-offset,mlen);
+    } else {
+      // the match overlaps itself, as runs do
+      for (SIZE_T i=0;i<mlen;i++) {
+	out[op+i]=out[op+i-offset];
+      }
+    }
+    op+=mlen;
+  }
+
+  return op==outlen;
+}
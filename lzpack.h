@@ -0,0 +1,27 @@
+#ifndef _lzpack
+#define _lzpack
+
+#include "global.h"
+
+//
+// A small LZ77 compressor for disk blocks (see DiskSystem)
+//
+// The compressed form is a series of sequences, each a token byte
+// whose high 4 bits are a count of literal bytes and whose low 4 bits
+// are a match length less 4, the literals, a u16 little endian offset
+// back into what has been decompressed, and the match.  A count of 15
+// goes on in the following bytes, each added to it, until one that
+// isn't 255.  The last sequence has only literals.  Nodes are mostly
+// zeros past their keys and values, and repeat their header fields,
+// so they shrink a lot, and quickly, with no library needed.
+//
+
+// Compress the len bytes of in into out, which has room for outmax
+// bytes.  Returns the compressed length, or 0 if it's more than outmax.
+SIZE_T lzpack_compress(const BYTE_T *in, const SIZE_T len, BYTE_T *out, const SIZE_T outmax);
+
+// Decompress the inlen bytes of in into exactly outlen bytes of out.
+// Returns false if in is not the compressed form of outlen bytes.
+bool   lzpack_decompress(const BYTE_T *in, const SIZE_T inlen, BYTE_T *out, const SIZE_T outlen);
+
+#endif
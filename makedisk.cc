@@ -6,27 +6,58 @@
 
 void usage() 
 {
-  cerr << "usage: makedisk filestem blocks blocksize heads blockspertrack tracks avgseek trackseek rotlat\n";
+  cerr << "usage: makedisk filestem blocks blocksize heads blockspertrack tracks avgseek trackseek rotlat [prealloc] [checksums] [compress] [stripes=n] [stripeunit=blocks]\n";
+  cerr << "       with stripes=n, blocks is the total over n member disks\n"
+       << "       and the geometry and performance are those of each member\n";
 }
 
 int main(int argc, char *argv[])
 {
+  bool prealloc=false;
+  bool checksums=false;
+  bool compress=false;
+  SIZE_T stripes=1;
+  SIZE_T stripeunit=1;
+
   if (argc<10) { 
     usage();
     exit(-1);
   }
 
+  for (int i=10;i<argc;i++) { 
+    string opt(argv[i]);
+    if (opt=="prealloc") { 
+      prealloc=true;
+    } else if (opt=="checksums") { 
+      checksums=true;
+    } else if (opt=="compress") { 
+      compress=true;
+    } else if (opt.compare(0,8,"stripes=")==0) { 
+      stripes=atoll(opt.c_str()+8);
+    } else if (opt.compare(0,11,"stripeunit=")==0) { 
+      stripeunit=atoll(opt.c_str()+11);
+    } else {
+      usage();
+      exit(-1);
+    }
+  }
+
   DiskSystem disk(argv[1],
 		  true,
 		  0,
-		  atoi(argv[2]),
+		  atoll(argv[2]),
 		  atoi(argv[3]),
 		  atoi(argv[4]),
 		  atoi(argv[5]),
 		  atoi(argv[6]),
 		  atof(argv[7]),
 		  atof(argv[8]),
-		  atof(argv[9]));
+		  atof(argv[9]),
+		  prealloc,
+		  stripes,
+		  stripeunit,
+		  checksums,
+		  compress);
   
   
   cerr << "Disk is as follows.\n" << disk << "\n";
@@ -16,8 +16,8 @@ int main(int argc, char *argv[])
     exit(-1);
   }
   SIZE_T cachesize=atoi(argv[1]);
-  SIZE_T blocknum=atoi(argv[3]);
-  SIZE_T numblocks=atoi(argv[4]);
+  SIZE_T blocknum=atoll(argv[3]);
+  SIZE_T numblocks=atoll(argv[4]);
 
   DiskSystem disk(argv[2]);
   BufferCache cache(&disk,cachesize);
@@ -15,8 +15,8 @@ int main(int argc, char *argv[])
     usage();
     exit(-1);
   }
-  SIZE_T blocknum=atoi(argv[2]);
-  SIZE_T numblocks=atoi(argv[3]);
+  SIZE_T blocknum=atoll(argv[2]);
+  SIZE_T numblocks=atoll(argv[3]);
   double reqtime;
 
   DiskSystem disk(argv[1]);
@@ -0,0 +1,187 @@
+#include <string>
+#include <map>
+#include <string.h>
+#include <stdlib.h>
+
+#include "buffercache.h"
+#include "trace.h"
+
+
+void usage() 
+{
+  cerr << "usage: replaytrace tracefile filestem cachesize [lru|mru|fifo|random]\n";
+  cerr << "       cachesize 0 replays the disk requests directly against the disk\n";
+  cerr << "       the disk's contents are left as they were\n";
+}
+
+// Read the current contents of every block the trace writes, so that
+// the replay can write back what is already there.  This is done
+// through a disk of its own, so the replay's timing starts clean.
+ERROR_T ReadWritten(Trace &trace,
+		    const char *filestem,
+		    const bool cacheops,
+		    map<SIZE_T,Block> &contents)
+{
+  DiskSystem disk(filestem);
+  TraceRecord r;
+  ERROR_T rc;
+
+  while ((rc=trace.Next(r))==ERROR_NOERROR) { 
+    SIZE_T first=r.block, num;
+    if (cacheops && r.op==TRACE_CACHE_WRITE) { 
+      num=1;
+    } else if (!cacheops && r.op==TRACE_DISK_WRITE) { 
+      num=r.numblocks;
+    } else {
+      continue;
+    }
+    for (SIZE_T b=first;b<first+num;b++) { 
+      if (contents.find(b)==contents.end()) { 
+	vector<Block> blocks;
+	double reqtime;
+	if ((rc=disk.Read(b,1,blocks,reqtime))!=ERROR_NOERROR) { 
+	  return rc;
+	}
+	contents.insert(pair<SIZE_T,Block>(b,blocks[0]));
+      }
+    }
+  }
+  return rc==ERROR_NONEXISTENT ? ERROR_NOERROR : rc;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc<4 || argc>5) { 
+    usage();
+    exit(-1);
+  }
+
+  SIZE_T cachesize=atoi(argv[3]);
+  CachePolicy policy=CACHE_LRU;
+
+  if (argc==5) { 
+    if (!strcmp(argv[4],"lru")) { 
+      policy=CACHE_LRU;
+    } else if (!strcmp(argv[4],"mru")) { 
+      policy=CACHE_MRU;
+    } else if (!strcmp(argv[4],"fifo")) { 
+      policy=CACHE_FIFO;
+    } else if (!strcmp(argv[4],"random")) { 
+      policy=CACHE_RANDOM;
+    } else {
+      usage();
+      exit(-1);
+    }
+  }
+
+  Trace trace;
+  ERROR_T rc;
+
+  if ((rc=trace.Open(argv[1]))!=ERROR_NOERROR) { 
+    cerr << "Can't open trace "<<argv[1]<<" due to error "<<rc<<endl;
+    return -1;
+  }
+
+  map<SIZE_T,Block> contents;
+
+  if ((rc=ReadWritten(trace,argv[2],cachesize>0,contents))!=ERROR_NOERROR ||
+      (rc=trace.Open(argv[1]))!=ERROR_NOERROR) { 
+    cerr << "Can't read the blocks the trace writes due to error "<<rc<<endl;
+    return -1;
+  }
+
+  DiskSystem disk(argv[2]);
+  BufferCache cache(&disk,cachesize,policy);
+
+  SIZE_T blocksize = disk.GetBlockSize();
+
+  if (trace.GetBlockSize()!=blocksize) { 
+    cerr << "Trace blocksize "<<trace.GetBlockSize()<<" does not match disk blocksize "<<blocksize<<endl;
+    return -1;
+  }
+  if (trace.GetNumBlocks()>disk.GetNumBlocks()) { 
+    cerr << "Trace needs "<<trace.GetNumBlocks()<<" blocks but the disk has "<<disk.GetNumBlocks()<<endl;
+    return -1;
+  }
+
+  SIZE_T numrecords=0, numreplayed=0;
+  double tracetime=0, disktime=0;
+  TraceRecord r;
+
+  cache.Attach();
+
+  while ((rc=trace.Next(r))==ERROR_NOERROR) { 
+    numrecords++;
+    if (cachesize>0) { 
+      // replay what the client asked of the cache
+      Block block(blocksize);
+      switch (r.op) { 
+      case TRACE_CACHE_READ:
+	rc=cache.ReadBlock(r.block,block);
+	break;
+      case TRACE_CACHE_WRITE:
+	// write back what the block already holds
+	rc=cache.WriteBlock(r.block,contents.find(r.block)->second);
+	break;
+      case TRACE_CACHE_FLUSH:
+	rc=cache.FlushBlock(r.block);
+	break;
+      case TRACE_CACHE_DETACH:
+	if ((rc=cache.Detach())==ERROR_NOERROR) { 
+	  rc=cache.Attach();
+	}
+	break;
+      default:
+	continue;
+      }
+    } else {
+      // replay what was asked of the disk
+      double reqtime=0;
+      vector<Block> blocks;
+      switch (r.op) { 
+      case TRACE_DISK_READ:
+	rc=disk.Read(r.block,r.numblocks,blocks,reqtime);
+	break;
+      case TRACE_DISK_WRITE:
+	// write back what the blocks already hold
+	for (SIZE_T i=0;i<r.numblocks;i++) { 
+	  blocks.push_back(contents.find(r.block+i)->second);
+	}
+	rc=disk.Write(r.block,r.numblocks,blocks,reqtime);
+	break;
+      default:
+	continue;
+      }
+      disktime+=reqtime;
+    }
+    if (rc!=ERROR_NOERROR) { 
+      cerr << "Error " << rc <<" occured when replaying record "<< numrecords << endl;
+      return -1;
+    }
+    tracetime+=r.simtime;
+    numreplayed++;
+  }
+
+  cache.Detach();
+
+  cerr << "Your trace was successfully replayed.\n";
+
+  cerr << "numrecords      = "<<numrecords<<endl;
+  cerr << "numreplayed     = "<<numreplayed<<endl;
+  cerr << endl;
+
+  if (cachesize>0) { 
+    cerr << "numreads        = "<<cache.GetNumReads()<<endl;
+    cerr << "numdiskreads    = "<<cache.GetNumDiskReads()<<endl;
+    cerr << "numwrites       = "<<cache.GetNumWrites()<<endl;
+    cerr << "numdiskwrites   = "<<cache.GetNumDiskWrites()<<endl;
+    cerr << endl;
+    cerr << "traced time     = "<<tracetime<<endl;
+    cerr << "total time      = "<<cache.GetCurrentTime()<<endl;
+  } else {
+    cerr << "traced time     = "<<tracetime<<endl;
+    cerr << "total time      = "<<disktime<<endl;
+  }
+
+  return 0;
+}
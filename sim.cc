@@ -11,7 +11,7 @@ using namespace std;
 
 void usage()
 {
-  cerr << "usage: sim filestem cachesize < specfile \n";
+  cerr << "usage: sim filestem cachesize [tracefile] [sync=none|detach|every:N|group:ms] < specfile \n";
 }
 
 
@@ -20,7 +20,7 @@ int main(int argc, char *argv[])
 
   // CONFORMS to the interface of ref_impl.pl
 
-  if (argc != 3){
+  if (argc < 3 || argc > 5){
     usage();
     return 1;
   }
@@ -39,8 +39,36 @@ int main(int argc, char *argv[])
   // so we need to do this outside the loop
   DiskSystem disk(filestem);
   BufferCache cache(&disk,cachesize);
-  // will be set on init
-  BTreeIndex *btree;
+  // will be set on init, and is 0 while there's no attached index
+  BTreeIndex *btree=0;
+  // optional block I/O trace, see replaytrace
+  Trace trace;
+
+  for (int i=3;i<argc;i++) { 
+    string arg=argv[i];
+    if (arg.substr(0,5)=="sync=") { 
+      string mode=arg.substr(5);
+      if (mode=="none") { 
+	disk.SetDurability(DURABILITY_NONE);
+      } else if (mode=="detach") { 
+	disk.SetDurability(DURABILITY_DETACH);
+      } else if (mode.substr(0,6)=="every:") { 
+	disk.SetDurability(DURABILITY_EVERYN,atof(mode.substr(6).c_str()));
+      } else if (mode.substr(0,6)=="group:") { 
+	disk.SetDurability(DURABILITY_GROUP,atof(mode.substr(6).c_str()));
+      } else {
+	usage();
+	return 1;
+      }
+    } else {
+      if ((rc=trace.Create(arg,disk.GetBlockSize(),disk.GetNumBlocks()))!=ERROR_NOERROR) { 
+	cerr << "Can't create trace due to error "<<rc<<"\n";
+	return -1;
+      }
+      disk.SetTrace(&trace);
+      cache.SetTrace(&trace);
+    }
+  }
 
 
   if ((rc=cache.Attach())!=ERROR_NOERROR) {
@@ -59,13 +87,49 @@ int main(int argc, char *argv[])
     is >> action >> key >> value;
 
     if (action == "INIT") {
-      btree = new BTreeIndex(atoi(key.c_str()),atoi(value.c_str()),&cache);
-      if ((rc=btree->Attach(0, true))!=ERROR_NOERROR) {
-	cerr << "Can't attach btree with initialization due to error "<<rc<<"\n";
+      // optionally followed by a node format (see btree_ds.h), a
+      // key order (see keyorder.h) and a key codec (see keycodec.h)
+      string formatname, ordername, codecname;
+      int format=BTREE_FORMAT_CURRENT;
+      KeyOrder order;
+      KeyCodec codec;
+      if (is >> formatname) { 
+	format=NodeFormatByName(formatname.c_str());
+      }
+      bool badorder = (is >> ordername) && KeyOrderByName(ordername.c_str(),order)<0;
+      bool badcodec = (is >> codecname) && KeyCodecByName(codecname.c_str(),codec)<0;
+      delete btree;
+      btree = 0;
+      if (format<0) { 
+	cerr << "Unknown node format "<<formatname<<"\n";
+	cout << "FAIL\n";
+      } else if (badorder) { 
+	cerr << "Unknown key order "<<ordername<<"\n";
+	cout << "FAIL\n";
+      } else if (badcodec) { 
+	cerr << "Unknown key codec "<<codecname<<"\n";
 	cout << "FAIL\n";
       } else {
-	cout << "OK\n";
+	btree = new BTreeIndex(atoi(key.c_str()),atoi(value.c_str()),&cache,true,format,order,codec);
+	if ((rc=btree->Attach(0, true))!=ERROR_NOERROR) {
+	  const char *why;
+	  cerr << "Can't attach btree with initialization due to error "<<rc;
+	  if (btree->CheckCreate(&why)!=ERROR_NOERROR) { 
+	    cerr << " ("<<why<<")";
+	  }
+	  cerr << "\n";
+	  cout << "FAIL\n";
+	  delete btree;
+	  btree = 0;
+	} else {
+	  cout << "OK\n";
+	}
       }
+    } else if (btree==0 && (action=="INSERT" || action=="UPDATE" || action=="DELETE" ||
+			    action=="LOOKUP" || action=="DISPLAY" || action=="DEINIT")) { 
+      // the rest need an attached index
+      cerr << "No index for "<<action<<", INIT failed or hasn't been done\n";
+      cout << "FAIL\n";
     } else if (action == "INSERT"){
       if ((rc=btree->Insert(KEY_T(key.c_str()),VALUE_T(value.c_str())))!=ERROR_NOERROR) { 
         cout <<"FAIL"<<endl;
@@ -114,6 +178,7 @@ int main(int argc, char *argv[])
 	  cerr <<"Can't detach cache due to error "<<rc<<endl;
 	} else {
 	  delete btree;
+	  btree = 0;
 	  cout << "OK\n";
 	}
       }
@@ -122,6 +187,11 @@ int main(int argc, char *argv[])
     
   fclose(file);
 
+  if (disk.GetNumSyncs()>0) { 
+    cerr << "numsyncs        = "<<disk.GetNumSyncs()<<endl;
+    cerr << "sync time       = "<<disk.GetSyncTime()<<endl;
+  }
+
   return 0;
 
 }
@@ -0,0 +1,106 @@
+#include <time.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define TRACE_MAGIC   0x45435254   // "TRCE"
+#define TRACE_VERSION 1
+
+Trace::Trace() : file(0)
+{
+  memset(&header,0,sizeof(header));
+}
+
+Trace::~Trace()
+{
+  Close();
+}
+
+ERROR_T Trace::Create(const string &filename, const SIZE_T blocksize, const SIZE_T numblocks)
+{
+  Close();
+
+  if ((file=fopen(filename.c_str(),"w"))==0) { 
+    return ERROR_NOFILE;
+  }
+
+  header.magic=TRACE_MAGIC;
+  header.version=TRACE_VERSION;
+  header.blocksize=blocksize;
+  header.numblocks=numblocks;
+
+  if (fwrite(&header,sizeof(header),1,file)!=1) { 
+    return ERROR_NOSPACE;
+  }
+
+  return ERROR_NOERROR;
+}
+
+ERROR_T Trace::Open(const string &filename)
+{
+  Close();
+
+  if ((file=fopen(filename.c_str(),"r"))==0) { 
+    return ERROR_NOFILE;
+  }
+
+  if (fread(&header,sizeof(header),1,file)!=1 || 
+      header.magic!=TRACE_MAGIC ||
+      header.version!=TRACE_VERSION) { 
+    return ERROR_BADCONFIG;
+  }
+
+  return ERROR_NOERROR;
+}
+
+ERROR_T Trace::Close()
+{
+  if (file) { 
+    fclose(file);
+    file=0;
+  }
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T Trace::Record(const TraceOp  op,
+		      const SIZE_T   block,
+		      const SIZE_T   numblocks,
+		      const bool     hit,
+		      const double   simtime,
+		      const uint64_t walltime)
+{
+  TraceRecord r;
+
+  r.op=op;
+  r.flags=hit ? TRACE_HIT : 0;
+  r.reserved=0;
+  r.numblocks=numblocks;
+  r.block=block;
+  r.simtime=simtime;
+  r.walltime=walltime;
+
+  if (!file || fwrite(&r,sizeof(r),1,file)!=1) { 
+    return ERROR_NOSPACE;
+  }
+  return ERROR_NOERROR;
+}
+
+
+ERROR_T Trace::Next(TraceRecord &r)
+{
+  if (!file || fread(&r,sizeof(r),1,file)!=1) { 
+    return ERROR_NONEXISTENT;
+  }
+  return ERROR_NOERROR;
+}
+
+
+uint64_t Trace::Now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+
+  return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
@@ -0,0 +1,89 @@
+#ifndef _trace
+#define _trace
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+#include "global.h"
+
+using namespace std;
+
+//
+// Block I/O trace
+//
+// A trace file is a TraceHeader followed by one TraceRecord per 
+// request made of a BufferCache or a DiskSystem that has been handed
+// the Trace with SetTrace.  Cache records are the requests the client
+// (the B-tree) made; disk records are what the cache (or the client,
+// if there is no cache) asked of the disk as a result.
+//
+// replaytrace re-drives the cache records against any cache size,
+// replacement policy, and disk, or the disk records against any disk.
+//
+
+enum TraceOp {
+  TRACE_CACHE_READ=1,     
+  TRACE_CACHE_WRITE=2,
+  TRACE_CACHE_FLUSH=3,    // FlushBlock
+  TRACE_CACHE_DETACH=4,   // Detach, which flushes everything
+  TRACE_DISK_READ=5,
+  TRACE_DISK_WRITE=6,
+  TRACE_DISK_SYNC=7       // fdatasync, see DiskSystem::SetDurability
+};
+
+// TraceRecord flags
+#define TRACE_HIT 0x1     // cache request was satisfied without the disk
+
+struct TraceHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t blocksize;
+  uint64_t numblocks;
+};
+
+struct TraceRecord {
+  uint8_t  op;
+  uint8_t  flags;
+  uint16_t reserved;
+  uint32_t numblocks;
+  uint64_t block;
+  double   simtime;    // simulated milliseconds the request took
+  uint64_t walltime;   // wall clock nanoseconds the request took
+};
+
+
+class Trace {
+ private:
+  FILE        *file;
+  TraceHeader  header;
+ public:
+  Trace();
+  Trace(const Trace &rhs) { throw GenericException(); }
+  Trace & operator=(const Trace &rhs) { throw GenericException(); return *this; }
+  ~Trace();
+
+  // Start a new trace of a disk with the given geometry
+  ERROR_T Create(const string &filename, const SIZE_T blocksize, const SIZE_T numblocks);
+  // Open an existing trace for reading
+  ERROR_T Open(const string &filename);
+  ERROR_T Close();
+
+  ERROR_T Record(const TraceOp op,
+		 const SIZE_T  block,
+		 const SIZE_T  numblocks,
+		 const bool    hit,
+		 const double  simtime,
+		 const uint64_t walltime);
+
+  // returns ERROR_NONEXISTENT at the end of the trace
+  ERROR_T Next(TraceRecord &rec);
+
+  SIZE_T GetBlockSize() const { return header.blocksize; }
+  SIZE_T GetNumBlocks() const { return header.numblocks; }
+
+  // Wall clock in nanoseconds, for timing requests
+  static uint64_t Now();
+};
+
+#endif